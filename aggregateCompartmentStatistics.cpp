@@ -0,0 +1,234 @@
+/*
+Tool to aggregate statistical measurements of terminal compartments, as output
+by imageLabelStatistics, along the airway tree in AirwayTree.meta.
+
+```bash
+./imageLabelStatistics m01_AerosolSub2.mha m01_TerminalCompartments.nrrd > m01_CompartmentStatistics.csv
+./aggregateCompartmentStatistics m01_AirwayTree.meta m01_CompartmentStatistics.csv m01_SegmentStatistics.csv
+```
+
+The labels of the statistics table are joined with the IDs of the airway
+segments, i.e. terminal compartments contribute to their terminal segment.
+For every segment, volume, voxel count, and intensity sum (mean*count, e.g.
+deposited aerosol) of its own region, of its whole subtree (all regions
+supplied by the segment), and of the path from the trachea to the segment are
+written as one row of a Comma Separated Value (CSV) table, along with the
+subtree's fraction of its parent's and of the tree's total intensity sum.
+
+Subtree aggregates are computed in a bottom-up and path aggregates in a
+top-down pass over the tree levels; segments of the same level are processed
+in parallel. The total effort is linear in the number of segments.
+*/
+
+#include <itkMultiThreaderBase.h>
+#include <itkSpatialObject.h>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include "lapdMouseAsyncReader.h"
+#include "lapdMouseTreeSegments.h"
+#include "lapdMouseTreeMorphometry.h"
+
+// aggregated measurements of a region
+struct RegionStatistics
+{
+  unsigned int compartments = 0;
+  double volume = 0;
+  double count = 0;
+  double sum = 0;
+
+  void Add(const RegionStatistics& other)
+  {
+    compartments += other.compartments;
+    volume += other.volume;
+    count += other.count;
+    sum += other.sum;
+  }
+  double GetMean() const { return count>0 ? sum/count : 0; }
+};
+
+// read table output by imageLabelStatistics: label -> region statistics
+bool ReadLabelStatistics(const std::string& filename,
+  std::unordered_map<unsigned int, RegionStatistics>& statistics)
+{
+  std::ifstream infile( filename.c_str() );
+  if (!infile.good())
+    return false;
+
+  // locate required columns in header
+  std::string line, column;
+  std::getline(infile, line);
+  std::istringstream headerStream(line);
+  int labelColumn = -1, volumeColumn = -1, meanColumn = -1, countColumn = -1;
+  for (int c=0; std::getline(headerStream, column, ','); ++c)
+  {
+    if (column=="label") labelColumn = c;
+    else if (column=="volume") volumeColumn = c;
+    else if (column=="mean") meanColumn = c;
+    else if (column=="count") countColumn = c;
+  }
+  if (labelColumn<0 || volumeColumn<0 || meanColumn<0 || countColumn<0)
+    return false;
+
+  while (std::getline(infile, line))
+  {
+    std::istringstream lineStream(line);
+    double label = -1, volume = 0, mean = 0, count = 0;
+    for (int c=0; std::getline(lineStream, column, ','); ++c)
+    {
+      if (c==labelColumn) label = atof(column.c_str());
+      else if (c==volumeColumn) volume = atof(column.c_str());
+      else if (c==meanColumn) mean = atof(column.c_str());
+      else if (c==countColumn) count = atof(column.c_str());
+    }
+    if (label<=0)
+      continue;
+    RegionStatistics& region = statistics[static_cast<unsigned int>(label)];
+    region.compartments += 1;
+    region.volume += volume;
+    region.count += count;
+    region.sum += mean*count;
+  }
+  return true;
+}
+
+int main(int argc, char**argv)
+{
+  if (argc!=4)
+  {
+    std::cerr << "Usage: " << argv[0] << " airwayTree labelStatistics output" << std::endl;
+    return -1;
+  }
+
+  std::string treeFilename = argv[1];
+  std::string statisticsFilename = argv[2];
+  std::string outputFilename = argv[3];
+
+  // start reading airwayTree while the statistics table is parsed
+  std::future<itk::SpatialObject<3>::Pointer> treeFuture =
+    lapdMouse::ReadTreeAsync( treeFilename );
+
+  std::unordered_map<unsigned int, RegionStatistics> labelStatistics;
+  if (!ReadLabelStatistics( statisticsFilename, labelStatistics ))
+  {
+    std::cerr << "Error: unable to read label statistics " << statisticsFilename << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  lapdMouse::TreeSegments segments;
+  try
+  {
+    itk::SpatialObject<3>::Pointer tree = treeFuture.get();
+    segments = lapdMouse::FlattenTree( tree.GetPointer(), true );
+  }
+  catch( itk::ExceptionObject & e )
+  {
+    std::cout << e << std::endl;
+    return EXIT_FAILURE;
+  }
+  const size_t numberOfSegments = segments.GetNumberOfSegments();
+  const std::vector<lapdMouse::SegmentMorphometry> morphometry =
+    lapdMouse::ComputeMorphometry( segments );
+
+  // join statistics with segments by ID
+  std::vector<RegionStatistics> own(numberOfSegments);
+  size_t joinedLabels = 0;
+  for (size_t s=0; s<numberOfSegments; ++s)
+  {
+    std::unordered_map<unsigned int, RegionStatistics>::const_iterator it =
+      labelStatistics.find(segments.ids[s]);
+    if (it==labelStatistics.end())
+      continue;
+    own[s] = it->second;
+    ++joinedLabels;
+  }
+  if (joinedLabels<labelStatistics.size())
+    std::cerr << "Warning: " << labelStatistics.size()-joinedLabels
+      << " labels do not match any airway segment" << std::endl;
+
+  // the breadth-first order lists segments level by level; find the range
+  // of each level, so that all segments of a level can be processed at once
+  const std::vector<size_t> order = lapdMouse::GetBreadthFirstOrder( segments );
+  std::vector<size_t> levelOffsets(1, 0);
+  for (size_t i=1; i<order.size(); ++i)
+    if (morphometry[order[i]].generation!=morphometry[order[i-1]].generation)
+      levelOffsets.push_back(i);
+  levelOffsets.push_back(order.size());
+  const size_t numberOfLevels = levelOffsets.size()-1;
+
+  // bottom-up pass: a segment's subtree consists of its own region and the
+  // subtrees of its children, which are all on the next level
+  std::vector<RegionStatistics> subtree(numberOfSegments);
+  itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+  for (size_t level=numberOfLevels; level-->0; )
+  {
+    threader->ParallelizeArray( levelOffsets[level], levelOffsets[level+1],
+      [&](itk::SizeValueType i)
+      {
+        const size_t s = order[i];
+        RegionStatistics region = own[s];
+        for (size_t c=segments.childOffsets[s]; c<segments.childOffsets[s+1]; ++c)
+          region.Add(subtree[segments.children[c]]);
+        subtree[s] = region;
+      }, nullptr );
+  }
+
+  // top-down pass: a segment's path consists of its parent's path and its
+  // own region; the total is the subtree of the segment's root
+  std::vector<RegionStatistics> path(numberOfSegments);
+  std::vector<size_t> root(numberOfSegments);
+  for (size_t level=0; level<numberOfLevels; ++level)
+  {
+    threader->ParallelizeArray( levelOffsets[level], levelOffsets[level+1],
+      [&](itk::SizeValueType i)
+      {
+        const size_t s = order[i];
+        const int parent = segments.parents[s];
+        RegionStatistics region = own[s];
+        if (parent>=0)
+        {
+          region.Add(path[parent]);
+          root[s] = root[parent];
+        }
+        else
+          root[s] = s;
+        path[s] = region;
+      }, nullptr );
+  }
+
+  // open output file for writing
+  std::ofstream outfile;
+  outfile.open( outputFilename.c_str() );
+
+  // write header
+  outfile << "label,parent,name,generation,pathLength,"
+    << "compartments,volume,count,sum,mean,"
+    << "subtreeCompartments,subtreeVolume,subtreeCount,subtreeSum,subtreeMean,"
+    << "fractionOfParent,fractionOfTotal,pathVolume,pathSum" << std::endl;
+
+  for (size_t s=0; s<numberOfSegments; ++s)
+  {
+    const int parent = segments.parents[s];
+    const double parentSum = parent>=0 ? subtree[parent].sum : subtree[s].sum;
+    const double totalSum = subtree[root[s]].sum;
+    outfile << segments.ids[s] << ","
+      << segments.parentIds[s] << ","
+      << segments.names[s] << ","
+      << morphometry[s].generation << ","
+      << morphometry[s].pathLength << ","
+      << own[s].compartments << "," << own[s].volume << ","
+      << own[s].count << "," << own[s].sum << "," << own[s].GetMean() << ","
+      << subtree[s].compartments << "," << subtree[s].volume << ","
+      << subtree[s].count << "," << subtree[s].sum << ","
+      << subtree[s].GetMean() << ","
+      << (parentSum!=0 ? subtree[s].sum/parentSum : 0) << ","
+      << (totalSum!=0 ? subtree[s].sum/totalSum : 0) << ","
+      << path[s].volume << "," << path[s].sum << std::endl;
+  }
+
+  outfile.close();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,338 @@
+/*
+Tool to compare named airway segments (e.g. trachea, left main bronchus)
+across the AirwayTree.meta files of several specimens.
+
+```bash
+./compareNamedSegments NamedSegments.csv m01_AirwayTree.meta m02_AirwayTree.meta m03_AirwayTree.meta
+./compareNamedSegments --metrics radius,length,generation NamedSegments.csv m*_AirwayTree.meta
+./compareNamedSegments --statistics m01_SegmentStatistics.csv,m02_SegmentStatistics.csv --metrics radius,subtreeSum NamedSegments.csv m01_AirwayTree.meta m02_AirwayTree.meta
+```
+
+All trees are read and measured in parallel (see lapdMouseTreeMorphometry.h).
+The segment names of all specimens are then interned into a single hash index,
+so that every distinct name is stored and compared once and segments are
+joined by integer name IDs. The result is a wide Comma Separated Value (CSV)
+table with one row per segment name and, for every specimen and measurement,
+one column named <specimen>_<measurement>. Specimens are named after the
+trees' filenames up to the first '_' (e.g. m01). Cells of specimens without a
+segment of the given name are left empty; unnamed segments are ignored.
+Available measurements are: id, length, arcLength, radius, minRadius,
+maxRadius, tortuosity, branchingAngle, generation, strahlerOrder, pathLength.
+
+Optionally, a table of per-segment statistics can be given for every tree (in
+the order of the trees), e.g. the output of aggregateCompartmentStatistics
+(deposition per segment and subtree) or the segment table of
+sampleCenterlineIntensities. Rows are joined with the tree's segments by the
+table's label or segmentId column, and all other columns become additional
+measurements, except for name and columns named like one of the measurements
+above. By default, all measurements are written.
+*/
+
+#include <itkMacro.h>
+#include <itkSpatialObject.h>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include "lapdMouseAsyncReader.h"
+#include "lapdMouseTreeSegments.h"
+#include "lapdMouseTreeMorphometry.h"
+
+// per-segment statistics table; values are kept as written, so that they
+// are copied to the output unchanged
+struct SegmentStatistics
+{
+  std::vector<std::string> columns;
+  std::vector<std::string> values; // [segment index*number of columns + column]
+};
+
+// measurements of one specimen's airway tree
+struct SpecimenTree
+{
+  lapdMouse::TreeSegments segments;
+  std::vector<lapdMouse::SegmentMorphometry> morphometry;
+  SegmentStatistics statistics;
+};
+
+// maps each distinct segment name to a dense integer ID
+class NameIndex
+{
+public:
+  // return ID of name; names not seen before are assigned the next ID
+  unsigned int Intern(const std::string& name)
+  {
+    std::pair<std::unordered_map<std::string, unsigned int>::iterator, bool>
+      result = m_Ids.emplace(name, static_cast<unsigned int>(m_Names.size()));
+    if (result.second)
+      m_Names.push_back(name);
+    return result.first->second;
+  }
+
+  const std::string& GetName(unsigned int id) const { return m_Names[id]; }
+  size_t GetNumberOfNames() const { return m_Names.size(); }
+
+private:
+  std::unordered_map<std::string, unsigned int> m_Ids;
+  std::vector<std::string> m_Names;
+};
+
+// names of available measurements
+const std::vector<std::string> AvailableMeasurements = { "id", "length",
+  "arcLength", "radius", "minRadius", "maxRadius", "tortuosity",
+  "branchingAngle", "generation", "strahlerOrder", "pathLength" };
+
+// read statistics table and join its rows with segments by ID
+SegmentStatistics ReadSegmentStatistics(const std::string& filename,
+  const lapdMouse::TreeSegments& segments)
+{
+  std::ifstream infile( filename.c_str() );
+  if (!infile.good())
+    itkGenericExceptionMacro( "unable to read " << filename );
+
+  // locate ID column and columns providing additional measurements
+  std::string line, column;
+  std::getline(infile, line);
+  std::istringstream headerStream(line);
+  int idColumn = -1;
+  std::vector<int> columnIndices; // table column -> statistics column or -1
+  SegmentStatistics statistics;
+  for (int c=0; std::getline(headerStream, column, ','); ++c)
+  {
+    columnIndices.push_back(-1);
+    if (column=="label" || column=="segmentId")
+      idColumn = c;
+    else if (column!="name" && std::find(AvailableMeasurements.begin(),
+      AvailableMeasurements.end(), column)==AvailableMeasurements.end())
+    {
+      columnIndices[c] = int(statistics.columns.size());
+      statistics.columns.push_back(column);
+    }
+  }
+  if (idColumn<0)
+    itkGenericExceptionMacro( "no label or segmentId column in " << filename );
+
+  // segments are sorted by ID
+  const size_t numberOfColumns = statistics.columns.size();
+  statistics.values.resize(segments.GetNumberOfSegments()*numberOfColumns);
+  size_t unmatchedRows = 0;
+  std::vector<std::string> row;
+  while (std::getline(infile, line))
+  {
+    std::istringstream lineStream(line);
+    row.clear();
+    while (std::getline(lineStream, column, ','))
+      row.push_back(column);
+    if (int(row.size())<=idColumn)
+      continue;
+    const unsigned int id = static_cast<unsigned int>(atoi(row[idColumn].c_str()));
+    std::vector<unsigned int>::const_iterator it = std::lower_bound(
+      segments.ids.begin(), segments.ids.end(), id);
+    if (it==segments.ids.end() || *it!=id)
+    {
+      ++unmatchedRows;
+      continue;
+    }
+    const size_t s = it-segments.ids.begin();
+    for (size_t c=0; c<row.size() && c<columnIndices.size(); ++c)
+      if (columnIndices[c]>=0)
+        statistics.values[s*numberOfColumns+columnIndices[c]] = row[c];
+  }
+  if (unmatchedRows>0)
+    std::cerr << "Warning: " << unmatchedRows << " rows of " << filename
+      << " do not match any airway segment" << std::endl;
+  return statistics;
+}
+
+// write measurement of a segment to stream
+void WriteMeasurement(std::ostream& stream, const std::string& measurement,
+  const SpecimenTree& specimen, size_t s)
+{
+  const SegmentStatistics& statistics = specimen.statistics;
+  std::vector<std::string>::const_iterator column = std::find(
+    statistics.columns.begin(), statistics.columns.end(), measurement);
+  if (column!=statistics.columns.end())
+  {
+    stream << statistics.values[s*statistics.columns.size()+
+      (column-statistics.columns.begin())];
+    return;
+  }
+  const lapdMouse::SegmentMorphometry& m = specimen.morphometry[s];
+  if (measurement=="id") stream << specimen.segments.ids[s];
+  else if (measurement=="length") stream << m.length;
+  else if (measurement=="arcLength") stream << m.arcLength;
+  else if (measurement=="radius") stream << m.meanRadius;
+  else if (measurement=="minRadius") stream << m.minRadius;
+  else if (measurement=="maxRadius") stream << m.maxRadius;
+  else if (measurement=="tortuosity") stream << m.tortuosity;
+  else if (measurement=="branchingAngle") stream << m.branchingAngle;
+  else if (measurement=="generation") stream << m.generation;
+  else if (measurement=="strahlerOrder") stream << m.strahlerOrder;
+  else if (measurement=="pathLength") stream << m.pathLength;
+}
+
+// specimen name is the filename without directory up to the first '_'
+std::string GetSpecimenName(const std::string& filename)
+{
+  std::string name = filename.substr(filename.find_last_of("/\\")+1);
+  const size_t separator = name.find('_');
+  if (separator!=std::string::npos && separator>0)
+    return name.substr(0, separator);
+  return name.substr(0, name.find('.'));
+}
+
+// split comma separated list
+std::vector<std::string> SplitList(const std::string& list)
+{
+  std::vector<std::string> elements;
+  std::istringstream listStream( list );
+  std::string element;
+  while (std::getline(listStream, element, ','))
+    elements.push_back(element);
+  return elements;
+}
+
+int main(int argc, char**argv)
+{
+  std::vector<std::string> measurements;
+  std::vector<std::string> statisticsFilenames;
+  int firstArgument = 1;
+  while (argc-firstArgument>2 && (std::string(argv[firstArgument])=="--metrics" ||
+    std::string(argv[firstArgument])=="--statistics"))
+  {
+    if (std::string(argv[firstArgument])=="--metrics")
+      measurements = SplitList( argv[firstArgument+1] );
+    else
+      statisticsFilenames = SplitList( argv[firstArgument+1] );
+    firstArgument += 2;
+  }
+  const size_t numberOfSpecimens = argc>firstArgument ? argc-firstArgument-1 : 0;
+  if (numberOfSpecimens<1 || (!statisticsFilenames.empty() &&
+    statisticsFilenames.size()!=numberOfSpecimens))
+  {
+    std::cerr << "Usage: " << argv[0]
+      << " [--metrics m1,m2,...] [--statistics table1,table2,...] output tree1 [tree2 ...]"
+      << std::endl;
+    return -1;
+  }
+
+  std::string outputFilename = argv[firstArgument];
+  std::vector<std::string> treeFilenames(argv+firstArgument+1, argv+argc);
+
+  // read, flatten and measure all trees and join their statistics concurrently
+  std::vector< std::future<SpecimenTree> > specimenFutures;
+  for (size_t i=0; i<numberOfSpecimens; ++i)
+  {
+    const std::string filename = treeFilenames[i];
+    const std::string statisticsFilename =
+      statisticsFilenames.empty() ? "" : statisticsFilenames[i];
+    specimenFutures.push_back( std::async(std::launch::async,
+      [filename, statisticsFilename]()
+    {
+      itk::SpatialObject<3>::Pointer tree = lapdMouse::ReadTreeAsync( filename ).get();
+      SpecimenTree specimen;
+      specimen.segments = lapdMouse::FlattenTree( tree.GetPointer(), true );
+      specimen.morphometry = lapdMouse::ComputeMorphometry( specimen.segments );
+      if (!statisticsFilename.empty())
+        specimen.statistics = ReadSegmentStatistics( statisticsFilename, specimen.segments );
+      return specimen;
+    }));
+  }
+  std::vector<SpecimenTree> specimens;
+  try
+  {
+    for (size_t i=0; i<numberOfSpecimens; ++i)
+      specimens.push_back( specimenFutures[i].get() );
+  }
+  catch( itk::ExceptionObject & e )
+  {
+    std::cout << e << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // available are the morphometric measurements and the columns of all
+  // statistics tables
+  std::vector<std::string> availableMeasurements = AvailableMeasurements;
+  for (size_t i=0; i<numberOfSpecimens; ++i)
+    for (size_t c=0; c<specimens[i].statistics.columns.size(); ++c)
+      if (std::find(availableMeasurements.begin(), availableMeasurements.end(),
+        specimens[i].statistics.columns[c])==availableMeasurements.end())
+        availableMeasurements.push_back(specimens[i].statistics.columns[c]);
+  if (measurements.empty())
+    measurements = availableMeasurements;
+  for (size_t j=0; j<measurements.size(); ++j)
+    if (std::find(availableMeasurements.begin(), availableMeasurements.end(),
+      measurements[j])==availableMeasurements.end())
+    {
+      std::cerr << "Error: unknown measurement " << measurements[j] << std::endl;
+      return -1;
+    }
+
+  // intern segment names in order of specimens and segment IDs, so that rows
+  // follow the first specimen's tree structure
+  NameIndex names;
+  std::vector< std::vector<unsigned int> > nameIds(numberOfSpecimens);
+  for (size_t i=0; i<numberOfSpecimens; ++i)
+  {
+    const lapdMouse::TreeSegments& segments = specimens[i].segments;
+    nameIds[i].resize(segments.GetNumberOfSegments());
+    for (size_t s=0; s<segments.GetNumberOfSegments(); ++s)
+      if (!segments.names[s].empty())
+        nameIds[i][s] = names.Intern(segments.names[s]);
+  }
+
+  // join segments: table of segment index per name and specimen; if a name
+  // occurs more than once in a tree, the segment with the lowest ID is used
+  const size_t numberOfNames = names.GetNumberOfNames();
+  const size_t missing = static_cast<size_t>(-1);
+  std::vector<size_t> joined(numberOfNames*numberOfSpecimens, missing);
+  for (size_t i=0; i<numberOfSpecimens; ++i)
+  {
+    const lapdMouse::TreeSegments& segments = specimens[i].segments;
+    for (size_t s=0; s<segments.GetNumberOfSegments(); ++s)
+    {
+      if (segments.names[s].empty())
+        continue;
+      size_t& entry = joined[nameIds[i][s]*numberOfSpecimens+i];
+      if (entry==missing)
+        entry = s;
+      else
+        std::cerr << "Warning: segment name " << segments.names[s]
+          << " occurs more than once in " << treeFilenames[i] << std::endl;
+    }
+  }
+
+  // open output file for writing
+  std::ofstream outfile;
+  outfile.open( outputFilename.c_str() );
+
+  // write header
+  outfile << "name";
+  for (size_t i=0; i<numberOfSpecimens; ++i)
+    for (size_t j=0; j<measurements.size(); ++j)
+      outfile << "," << GetSpecimenName(treeFilenames[i]) << "_" << measurements[j];
+  outfile << std::endl;
+
+  // write one row per segment name
+  for (size_t n=0; n<numberOfNames; ++n)
+  {
+    outfile << names.GetName(n);
+    for (size_t i=0; i<numberOfSpecimens; ++i)
+    {
+      const size_t s = joined[n*numberOfSpecimens+i];
+      for (size_t j=0; j<measurements.size(); ++j)
+      {
+        outfile << ",";
+        if (s!=missing)
+          WriteMeasurement(outfile, measurements[j], specimens[i], s);
+      }
+    }
+    outfile << std::endl;
+  }
+
+  outfile.close();
+
+  return EXIT_SUCCESS;
+}
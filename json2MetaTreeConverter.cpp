@@ -0,0 +1,56 @@
+/*
+Tool to convert airway trees in the Java Script Object Notation (JSON) format
+written by metaTree2JsonConverter back into AirwayTree.meta files.
+
+```bash
+./json2MetaTreeConverter m01_AirwayTree.json m01_AirwayTree.meta
+```
+
+This allows to edit trees, e.g. with python, and to use the edited trees with
+the other tools. The JSON file is parsed in a single pass and the parent/child
+relations given by the segments' Children lists are verified. Each segment is
+attached to the centerline point of its parent stored as ParentPoint. Only for
+JSON files without ParentPoint, written by earlier versions of
+metaTree2JsonConverter, it is attached to the parent's centerline point
+closest to its first centerline point.
+*/
+
+// ITK includes
+#include <itkSpatialObjectWriter.h>
+#include "lapdMouseJsonTreeReader.h"
+
+int main(int argc, char**argv)
+{
+  if (argc!=3)
+  {
+    std::cerr << "Usage: " << argv[0] << " input output" << std::endl;
+    return -1;
+  }
+
+  std::string inputFilename = argv[1];
+  std::string outputFilename = argv[2];
+
+  try
+  {
+    // read JSON tree into contiguous arrays and verify its structure
+    lapdMouse::TreeSegments segments = lapdMouse::ReadJsonTree( inputFilename );
+
+    // create hierarchy of spatial objects
+    itk::GroupSpatialObject<3>::Pointer tree =
+      lapdMouse::BuildSpatialObjectTree( segments );
+
+    // write tree
+    typedef itk::SpatialObjectWriter<3,float> WriterType;
+    WriterType::Pointer writer = WriterType::New();
+    writer->SetInput( tree );
+    writer->SetFileName( outputFilename.c_str() );
+    writer->Update();
+  }
+  catch( itk::ExceptionObject & e )
+  {
+    std::cout << e << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
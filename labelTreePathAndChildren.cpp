@@ -16,11 +16,10 @@ is output to highlightedSegmentsMesh.vtk.
 */
 
 #include <itkMesh.h>
-#include <itkMeshFileReader.h>
 #include <itkMeshFileWriter.h>
 #include <itkSpatialObject.h>
-#include <itkSpatialObjectReader.h>
 #include <set>
+#include "lapdMouseAsyncReader.h"
 
 int main(int argc, char**argv)
 {
@@ -32,23 +31,19 @@ int main(int argc, char**argv)
 
   unsigned int segmentId = atoi(argv[3]);
 
-  // read airwaySegmentsMesh
+  // start reading airwaySegmentsMesh and airwayTree concurrently; the tree is
+  // searched while the mesh is still loading
   using MeshType = itk::Mesh< float, 3 >;
   std::string segmentMeshFilename = argv[1];
-  using MeshReaderType = itk::MeshFileReader<MeshType>;
-  MeshReaderType::Pointer meshReader = MeshReaderType::New();
-  meshReader->SetFileName( segmentMeshFilename.c_str() );
-  meshReader->Update();
-  MeshType::Pointer mesh = meshReader->GetOutput();
-
-  // read airwayTree
+  std::future<MeshType::Pointer> meshFuture =
+    lapdMouse::ReadMeshAsync<MeshType>( segmentMeshFilename );
   using SpatialObjectType = itk::SpatialObject<3>;
   std::string treeFilename = argv[2];
-  using TreeReaderType = itk::SpatialObjectReader<3,float>;
-  TreeReaderType::Pointer treeReader = TreeReaderType::New();
-  treeReader->SetFileName( treeFilename );
-  treeReader->Update();
-  SpatialObjectType::Pointer tree( treeReader->GetGroup() );
+  std::future<SpatialObjectType::Pointer> treeFuture =
+    lapdMouse::ReadTreeAsync( treeFilename );
+
+  // wait for airwayTree
+  SpatialObjectType::Pointer tree = treeFuture.get();
 
   // search for segment with user specified ID
   using TubeType = itk::TubeSpatialObject<3>;
@@ -92,6 +87,9 @@ int main(int argc, char**argv)
   }
   delete children;
 
+  // wait for airwaySegmentsMesh
+  MeshType::Pointer mesh = meshFuture.get();
+
   // assign labeling to mesh point data:
   // 1: user specified segment
   // 2: segments on path from root
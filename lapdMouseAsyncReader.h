@@ -0,0 +1,96 @@
+/*
+Helpers to read the images, labelmaps, meshes, and tree structures used in the
+lapdMouse project asynchronously.
+
+Each function starts reading the given file on its own thread and immediately
+returns a std::future. Tools can thereby start all independent reads at once
+and only wait for an input when it is actually needed, e.g.:
+
+```c++
+auto lobesFuture = lapdMouse::ReadImageAsync<LabelmapType>( argv[1] );
+auto treeFuture = lapdMouse::ReadTreeAsync( argv[2] );
+SpatialObjectType::Pointer tree = treeFuture.get(); // process tree ...
+LabelmapType::Pointer lobes = lobesFuture.get();    // ... while lobes load
+```
+
+Exceptions thrown while reading (e.g. itk::ExceptionObject) are rethrown by
+the future's get(). Tree structures may also be given in the JSON format of
+metaTree2JsonConverter (files ending with .json).
+*/
+
+#ifndef lapdMouseAsyncReader_h
+#define lapdMouseAsyncReader_h
+
+// ITK includes
+#include <itkImageFileReader.h>
+#include <itkMeshFileReader.h>
+#include <itkSpatialObject.h>
+#include <itkSpatialObjectReader.h>
+#include "lapdMouseJsonTreeReader.h"
+
+#include <future>
+#include <string>
+
+namespace lapdMouse
+{
+
+// read an image or labelmap of type TImage
+template <typename TImage>
+std::future<typename TImage::Pointer> ReadImageAsync(const std::string& filename)
+{
+  return std::async(std::launch::async, [filename]()
+  {
+    using ReaderType = itk::ImageFileReader<TImage>;
+    typename ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName( filename );
+    reader->Update();
+    typename TImage::Pointer image = reader->GetOutput();
+    image->DisconnectPipeline();
+    return image;
+  });
+}
+
+// read a mesh of type TMesh
+template <typename TMesh>
+std::future<typename TMesh::Pointer> ReadMeshAsync(const std::string& filename)
+{
+  return std::async(std::launch::async, [filename]()
+  {
+    using ReaderType = itk::MeshFileReader<TMesh>;
+    typename ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName( filename );
+    reader->Update();
+    typename TMesh::Pointer mesh = reader->GetOutput();
+    mesh->DisconnectPipeline();
+    return mesh;
+  });
+}
+
+// read a tree structure (e.g. AirwayTree.meta or AirwayTree.json); segments
+// of JSON files without ParentPoint (written by earlier versions of
+// metaTree2JsonConverter) are connected to their parent's centerline point
+// closest to their start, which may differ from the original AirwayTree.meta
+inline std::future<itk::SpatialObject<3>::Pointer> ReadTreeAsync(const std::string& filename)
+{
+  return std::async(std::launch::async, [filename]()
+  {
+    const std::string jsonExtension = ".json";
+    if (filename.size()>jsonExtension.size() && filename.compare(
+      filename.size()-jsonExtension.size(), jsonExtension.size(), jsonExtension)==0)
+    {
+      itk::SpatialObject<3>::Pointer tree(
+        BuildSpatialObjectTree( ReadJsonTree(filename) ).GetPointer() );
+      return tree;
+    }
+    using ReaderType = itk::SpatialObjectReader<3,float>;
+    ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName( filename );
+    reader->Update();
+    itk::SpatialObject<3>::Pointer tree( reader->GetGroup() );
+    return tree;
+  });
+}
+
+} // namespace lapdMouse
+
+#endif
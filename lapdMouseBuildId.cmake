@@ -0,0 +1,21 @@
+# Computes the build ID of a tool caching its outputs (see
+# lapdMouseStageCache.h) and writes it to a header. Run at build time by
+# CMakeLists.txt, so that any change of the tool's source or of the shared
+# headers yields a new ID, even without configuring again.
+#
+# Variables: SOURCE_DIR, TOOL_SOURCE, ITK_VERSION, OUTPUT
+
+FILE(GLOB LAPDMOUSE_HEADERS ${SOURCE_DIR}/lapdMouse*.h)
+LIST(SORT LAPDMOUSE_HEADERS)
+SET(LAPDMOUSE_HASHES "")
+FOREACH(file ${SOURCE_DIR}/${TOOL_SOURCE} ${LAPDMOUSE_HEADERS})
+  FILE(SHA256 ${file} fileHash)
+  GET_FILENAME_COMPONENT(fileName ${file} NAME)
+  STRING(APPEND LAPDMOUSE_HASHES "${fileName}:${fileHash};")
+ENDFOREACH()
+STRING(SHA256 LAPDMOUSE_SOURCE_HASH "${LAPDMOUSE_HASHES}")
+
+# only rewritten if the ID changed, so that tools are not rebuilt needlessly
+FILE(CONFIGURE OUTPUT ${OUTPUT} CONTENT
+  "#define LAPDMOUSE_BUILD_ID \"${LAPDMOUSE_SOURCE_HASH} ITK ${ITK_VERSION}\"\n"
+  @ONLY)
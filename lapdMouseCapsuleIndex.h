@@ -0,0 +1,181 @@
+/*
+Helper to find the airway segment closest to arbitrary points, e.g. the
+vertices of a surface mesh.
+
+The airway tree is represented as a chain of capsules per segment and the
+distance of a point to a capsule is signed, i.e. negative inside the airway
+(see lapdMouseCapsules.h). Capsules are organized in a bounding volume hierarchy over the boxes of their axes;
+every node additionally stores the largest radius below it, so that the
+distance to a node's box minus this radius bounds the distance to all its
+capsules from below and whole subtrees can be skipped during a query.
+Queries only read the index and can be run concurrently.
+
+The tree should be flattened with includeParentPoint set, so that segments
+are connected to their parents (see lapdMouseTreeSegments.h).
+*/
+
+#ifndef lapdMouseCapsuleIndex_h
+#define lapdMouseCapsuleIndex_h
+
+#include "lapdMouseCapsules.h"
+#include "lapdMouseTreeSegments.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace lapdMouse
+{
+
+// bounding volume hierarchy over the centerline capsules of all segments
+class CapsuleIndex
+{
+public:
+  explicit CapsuleIndex(const TreeSegments& segments)
+  {
+    std::vector<Capsule> capsules = CreateCapsules(segments);
+    if (capsules.empty())
+      return;
+    m_Nodes.reserve(2*capsules.size()/LeafSize+1);
+    Build(capsules, 0, capsules.size());
+    m_Capsules.swap(capsules);
+  }
+
+  size_t GetNumberOfCapsules() const { return m_Capsules.size(); }
+
+  // return index of the segment closest to point and its signed distance;
+  // ties are resolved in favor of the lower segment index; returns -1 if the
+  // tree has no centerline points
+  int FindNearestSegment(const float point[3], float& distance) const
+  {
+    distance = std::numeric_limits<float>::max();
+    if (m_Nodes.empty())
+      return -1;
+    uint32_t nearestSegment = 0;
+    uint32_t stack[64];
+    float stackBounds[64];
+    unsigned int stackSize = 0;
+    stack[stackSize] = 0;
+    stackBounds[stackSize++] = GetLowerBound(m_Nodes[0], point);
+    while (stackSize>0)
+    {
+      --stackSize;
+      if (stackBounds[stackSize]>distance)
+        continue;
+      const Node& node = m_Nodes[stack[stackSize]];
+      if (node.count>0)
+      {
+        for (uint32_t c=node.first; c<node.first+node.count; ++c)
+        {
+          const float d = GetSignedDistance(m_Capsules[c], point);
+          const uint32_t segment = m_Capsules[c].segment;
+          if (d<distance || (d==distance && segment<nearestSegment))
+          {
+            distance = d;
+            nearestSegment = segment;
+          }
+        }
+        continue;
+      }
+      // visit nearer child first
+      const uint32_t left = stack[stackSize]+1;
+      const uint32_t right = node.first;
+      const float leftBound = GetLowerBound(m_Nodes[left], point);
+      const float rightBound = GetLowerBound(m_Nodes[right], point);
+      const bool leftFirst = leftBound<=rightBound;
+      stack[stackSize] = leftFirst ? right : left;
+      stackBounds[stackSize++] = leftFirst ? rightBound : leftBound;
+      stack[stackSize] = leftFirst ? left : right;
+      stackBounds[stackSize++] = leftFirst ? leftBound : rightBound;
+    }
+    return static_cast<int>(nearestSegment);
+  }
+
+private:
+  static const size_t LeafSize = 4;
+
+  // inner nodes store their right child's index in first and a count of 0;
+  // the left child directly follows its parent
+  struct Node
+  {
+    float lower[3];
+    float upper[3];
+    float maxRadius;
+    uint32_t first;
+    uint32_t count;
+  };
+
+  static float GetLowerBound(const Node& node, const float point[3])
+  {
+    float distance2 = 0;
+    for (unsigned int d=0; d<3; ++d)
+    {
+      const float delta = std::max(0.0f,
+        std::max(node.lower[d]-point[d], point[d]-node.upper[d]));
+      distance2 += delta*delta;
+    }
+    return std::sqrt(distance2)-node.maxRadius;
+  }
+
+  // build subtree for capsules [begin, end) by splitting at the median of
+  // the capsule centers along the axis of largest extent
+  void Build(std::vector<Capsule>& capsules, size_t begin, size_t end)
+  {
+    const size_t nodeIndex = m_Nodes.size();
+    m_Nodes.push_back(Node());
+    Node node;
+    float centerLower[3], centerUpper[3];
+    for (unsigned int d=0; d<3; ++d)
+    {
+      node.lower[d] = centerLower[d] = std::numeric_limits<float>::max();
+      node.upper[d] = centerUpper[d] = std::numeric_limits<float>::lowest();
+    }
+    node.maxRadius = 0;
+    for (size_t c=begin; c<end; ++c)
+    {
+      const Capsule& capsule = capsules[c];
+      for (unsigned int d=0; d<3; ++d)
+      {
+        node.lower[d] = std::min(node.lower[d], std::min(capsule.a[d], capsule.b[d]));
+        node.upper[d] = std::max(node.upper[d], std::max(capsule.a[d], capsule.b[d]));
+        const float center = 0.5f*(capsule.a[d]+capsule.b[d]);
+        centerLower[d] = std::min(centerLower[d], center);
+        centerUpper[d] = std::max(centerUpper[d], center);
+      }
+      node.maxRadius = std::max(node.maxRadius, std::max(capsule.radiusA, capsule.radiusB));
+    }
+
+    if (end-begin<=LeafSize)
+    {
+      node.first = static_cast<uint32_t>(begin);
+      node.count = static_cast<uint32_t>(end-begin);
+      m_Nodes[nodeIndex] = node;
+      return;
+    }
+
+    unsigned int axis = 0;
+    for (unsigned int d=1; d<3; ++d)
+      if (centerUpper[d]-centerLower[d]>centerUpper[axis]-centerLower[axis])
+        axis = d;
+    const size_t middle = begin+(end-begin)/2;
+    std::nth_element(capsules.begin()+begin, capsules.begin()+middle,
+      capsules.begin()+end, [axis](const Capsule& c1, const Capsule& c2)
+      {
+        return c1.a[axis]+c1.b[axis]<c2.a[axis]+c2.b[axis];
+      });
+    Build(capsules, begin, middle);
+    node.first = static_cast<uint32_t>(m_Nodes.size());
+    node.count = 0;
+    Build(capsules, middle, end);
+    m_Nodes[nodeIndex] = node;
+  }
+
+  std::vector<Capsule> m_Capsules;
+  std::vector<Node> m_Nodes;
+};
+
+} // namespace lapdMouse
+
+#endif
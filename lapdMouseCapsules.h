@@ -0,0 +1,91 @@
+/*
+Helpers to represent airway segments as chains of capsules.
+
+Every airway segment of a flattened tree (see lapdMouseTreeSegments.h) is
+represented as a chain of capsules connecting consecutive centerline points,
+with the radius interpolated linearly between the points. The signed distance
+of a point to a capsule is its distance to the capsule's axis minus the radius
+interpolated at the closest axis point, i.e. negative inside the airway. Tools
+such as rasterizeAirwayTree and lapdMouseCapsuleIndex.h share this geometry, so
+that labelmaps and nearest segment queries agree.
+
+The tree should be flattened with includeParentPoint set, so that segments
+are connected to their parents.
+*/
+
+#ifndef lapdMouseCapsules_h
+#define lapdMouseCapsules_h
+
+#include "lapdMouseTreeSegments.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace lapdMouse
+{
+
+// cone segment between two centerline points a and b
+struct Capsule
+{
+  float a[3];
+  float b[3];
+  float radiusA;
+  float radiusB;
+  uint32_t segment; // index of segment in TreeSegments
+};
+
+// convert centerline points of all segments into capsules in order of
+// segments; a segment with a single centerline point becomes a sphere
+inline std::vector<Capsule> CreateCapsules(const TreeSegments& segments)
+{
+  std::vector<Capsule> capsules;
+  capsules.reserve(segments.x.size());
+  for (size_t s=0; s<segments.GetNumberOfSegments(); ++s)
+  {
+    const size_t first = segments.pointOffsets[s];
+    const size_t last = segments.pointOffsets[s+1];
+    for (size_t p=first; p<last; ++p)
+    {
+      const size_t q = p+1<last ? p+1 : p;
+      if (q==p && p!=first)
+        break;
+      Capsule capsule;
+      capsule.a[0] = segments.x[p]; capsule.a[1] = segments.y[p]; capsule.a[2] = segments.z[p];
+      capsule.b[0] = segments.x[q]; capsule.b[1] = segments.y[q]; capsule.b[2] = segments.z[q];
+      capsule.radiusA = segments.radius[p];
+      capsule.radiusB = segments.radius[q];
+      capsule.segment = static_cast<uint32_t>(s);
+      capsules.push_back(capsule);
+    }
+  }
+  return capsules;
+}
+
+// distance of point to capsule's axis minus radius interpolated at the
+// closest axis point; negative inside the capsule
+inline float GetSignedDistance(const Capsule& capsule, const float point[3])
+{
+  float ab[3], ap[3];
+  float abab = 0, apab = 0;
+  for (unsigned int d=0; d<3; ++d)
+  {
+    ab[d] = capsule.b[d]-capsule.a[d];
+    ap[d] = point[d]-capsule.a[d];
+    abab += ab[d]*ab[d];
+    apab += ap[d]*ab[d];
+  }
+  const float t = abab>0 ? std::max(0.0f, std::min(1.0f, apab/abab)) : 0.0f;
+  float distance2 = 0;
+  for (unsigned int d=0; d<3; ++d)
+  {
+    const float delta = ap[d]-t*ab[d];
+    distance2 += delta*delta;
+  }
+  return std::sqrt(distance2)-(capsule.radiusA+t*(capsule.radiusB-capsule.radiusA));
+}
+
+} // namespace lapdMouse
+
+#endif
@@ -0,0 +1,238 @@
+/*
+Helpers to store labelmaps with sparse segment IDs compactly.
+
+Segment IDs of the airway tree are sparse and may exceed the range of
+unsigned short. WriteCompactLabelmap therefore remaps all labels of a
+labelmap to dense ordinals 1..N (0 remains background), stores the ordinals
+with the narrowest unsigned integer pixel type that fits N, and writes the
+ordinal-to-label table next to the labelmap, e.g.
+m01_TerminalCompartments.nrrd and m01_TerminalCompartmentsLabels.csv.
+
+Consumers read the labelmap with DispatchOnLabelPixelType and translate
+ordinals back to segment IDs with the table returned by ReadLabelTable. For
+labelmaps without table (e.g. m01_Lobes.nrrd) the table is the identity, so
+these are read transparently as well.
+*/
+
+#ifndef lapdMouseCompactLabelmap_h
+#define lapdMouseCompactLabelmap_h
+
+// ITK includes
+#include <itkImage.h>
+#include <itkImageFileWriter.h>
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+#include "lapdMouseImageTypeDispatch.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace lapdMouse
+{
+
+// table mapping dense ordinals to sparse labels; ordinal 0 is background
+class CompactLabelTable
+{
+public:
+  CompactLabelTable() : m_Labels(1, 0), m_Identity(true) {}
+
+  // add label and return its ordinal
+  unsigned int AddLabel(unsigned int label)
+  {
+    if (label==0)
+      return 0;
+    std::unordered_map<unsigned int, unsigned int>::const_iterator it =
+      m_Ordinals.find(label);
+    if (it!=m_Ordinals.end())
+      return it->second;
+    unsigned int ordinal = static_cast<unsigned int>(m_Labels.size());
+    m_Labels.push_back(label);
+    m_Ordinals[label] = ordinal;
+    m_Identity = false;
+    return ordinal;
+  }
+
+  // ordinal of label or 0 if label is not part of table
+  unsigned int GetOrdinal(unsigned int label) const
+  {
+    if (m_Identity)
+      return label;
+    std::unordered_map<unsigned int, unsigned int>::const_iterator it =
+      m_Ordinals.find(label);
+    return it!=m_Ordinals.end() ? it->second : 0;
+  }
+
+  // label of ordinal
+  unsigned int GetLabel(unsigned int ordinal) const
+  {
+    if (m_Identity || ordinal>=m_Labels.size())
+      return ordinal;
+    return m_Labels[ordinal];
+  }
+
+  // number of non-background labels
+  size_t GetNumberOfLabels() const { return m_Labels.size()-1; }
+
+  // true if no table was read or labels were added, i.e. ordinal==label
+  bool IsIdentity() const { return m_Identity; }
+
+  void Write(const std::string& filename) const
+  {
+    std::ofstream outfile( filename.c_str() );
+    outfile << "ordinal,label" << std::endl;
+    for (size_t ordinal=1; ordinal<m_Labels.size(); ++ordinal)
+      outfile << ordinal << "," << m_Labels[ordinal] << std::endl;
+  }
+
+  // read table; returns false and keeps identity mapping if file does not exist
+  bool Read(const std::string& filename)
+  {
+    std::ifstream infile( filename.c_str() );
+    if (!infile.good())
+      return false;
+    std::string line;
+    std::getline(infile, line); // skip header
+    while (std::getline(infile, line))
+    {
+      std::istringstream lineStream(line);
+      unsigned int ordinal = 0, label = 0;
+      char separator;
+      if (!(lineStream >> ordinal >> separator >> label))
+        continue;
+      if (ordinal>=m_Labels.size())
+        m_Labels.resize(ordinal+1, 0);
+      m_Labels[ordinal] = label;
+      m_Ordinals[label] = ordinal;
+    }
+    m_Identity = false;
+    return true;
+  }
+
+private:
+  std::vector<unsigned int> m_Labels;
+  std::unordered_map<unsigned int, unsigned int> m_Ordinals;
+  bool m_Identity;
+};
+
+// filename of the ordinal-to-label table stored next to a labelmap
+inline std::string GetLabelTableFilename(const std::string& labelmapFilename)
+{
+  std::string basename = labelmapFilename;
+  size_t directoryEnd = basename.find_last_of("/\\");
+  directoryEnd = directoryEnd==std::string::npos ? 0 : directoryEnd+1;
+  const std::string gzExtension = ".gz";
+  if (basename.size()>gzExtension.size() && basename.compare(
+    basename.size()-gzExtension.size(), gzExtension.size(), gzExtension)==0)
+    basename.erase(basename.size()-gzExtension.size());
+  size_t extensionStart = basename.find_last_of('.');
+  if (extensionStart!=std::string::npos && extensionStart>directoryEnd)
+    basename.erase(extensionStart);
+  return basename + "Labels.csv";
+}
+
+// read the table belonging to a labelmap (identity if there is none)
+inline CompactLabelTable ReadLabelTable(const std::string& labelmapFilename)
+{
+  CompactLabelTable table;
+  table.Read( GetLabelTableFilename(labelmapFilename) );
+  return table;
+}
+
+// call functor with PixelTypeTag<T>, where T is the unsigned integer type
+// able to hold the labels stored in the file
+template <typename TFunctor>
+void DispatchOnLabelPixelType(const std::string& filename, TFunctor&& functor)
+{
+  switch (ReadComponentType( filename ))
+  {
+    case itk::IOComponentEnum::UCHAR:
+      functor( PixelTypeTag<unsigned char>() ); break;
+    case itk::IOComponentEnum::CHAR:
+    case itk::IOComponentEnum::SHORT:
+    case itk::IOComponentEnum::USHORT:
+      functor( PixelTypeTag<unsigned short>() ); break;
+    default:
+      functor( PixelTypeTag<unsigned int>() ); break;
+  }
+}
+
+// write labels as ordinals of table using pixel type TOutputPixel
+template <typename TOutputPixel, typename TLabelmap>
+void WriteOrdinalLabelmap(const TLabelmap* labels, const CompactLabelTable& table,
+  const std::string& filename)
+{
+  using OutputLabelmapType = itk::Image<TOutputPixel, TLabelmap::ImageDimension>;
+  typename OutputLabelmapType::Pointer ordinals = OutputLabelmapType::New();
+  ordinals->CopyInformation( labels );
+  ordinals->SetRegions( labels->GetLargestPossibleRegion() );
+  ordinals->Allocate();
+
+  // neighboring voxels mostly share their label; remember last lookup
+  itk::ImageRegionConstIterator<TLabelmap> labelIt( labels,
+    labels->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator<OutputLabelmapType> ordinalIt( ordinals,
+    ordinals->GetLargestPossibleRegion() );
+  unsigned int lastLabel = 0;
+  TOutputPixel lastOrdinal = 0;
+  for (; !labelIt.IsAtEnd(); ++labelIt, ++ordinalIt)
+  {
+    const unsigned int label = static_cast<unsigned int>( labelIt.Get() );
+    if (label!=lastLabel)
+    {
+      lastLabel = label;
+      lastOrdinal = static_cast<TOutputPixel>( table.GetOrdinal(label) );
+    }
+    ordinalIt.Set( lastOrdinal );
+  }
+
+  using WriterType = itk::ImageFileWriter<OutputLabelmapType>;
+  typename WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( ordinals );
+  writer->SetFileName( filename.c_str() );
+  writer->SetUseCompression( true ); // labelmaps can get compressed efficiently
+  writer->Update();
+}
+
+// remap the labels of a labelmap with sparse IDs to dense ordinals and write
+// them with the narrowest pixel type possible, along with the label table
+template <typename TLabelmap>
+void WriteCompactLabelmap(const TLabelmap* labels, const std::string& filename)
+{
+  // collect set of labels
+  std::unordered_set<unsigned int> labelSet;
+  itk::ImageRegionConstIterator<TLabelmap> labelIt( labels,
+    labels->GetLargestPossibleRegion() );
+  unsigned int lastLabel = 0;
+  for (; !labelIt.IsAtEnd(); ++labelIt)
+  {
+    const unsigned int label = static_cast<unsigned int>( labelIt.Get() );
+    if (label!=lastLabel && label!=0)
+      labelSet.insert(label);
+    lastLabel = label;
+  }
+
+  // assign ordinals in ascending label order
+  std::vector<unsigned int> sortedLabels(labelSet.begin(), labelSet.end());
+  std::sort(sortedLabels.begin(), sortedLabels.end());
+  CompactLabelTable table;
+  for (size_t i=0; i<sortedLabels.size(); ++i)
+    table.AddLabel(sortedLabels[i]);
+
+  const size_t numberOfLabels = table.GetNumberOfLabels();
+  if (numberOfLabels<=itk::NumericTraits<unsigned char>::max())
+    WriteOrdinalLabelmap<unsigned char>( labels, table, filename );
+  else if (numberOfLabels<=itk::NumericTraits<unsigned short>::max())
+    WriteOrdinalLabelmap<unsigned short>( labels, table, filename );
+  else
+    WriteOrdinalLabelmap<unsigned int>( labels, table, filename );
+  table.Write( GetLabelTableFilename(filename) );
+}
+
+} // namespace lapdMouse
+
+#endif
@@ -0,0 +1,331 @@
+/*
+Helpers to look up image values at many physical points at once.
+
+ITK's TransformPhysicalPointToIndex and interpolate image functions handle one
+point per call. PhysicalToIndexTransform instead precomputes the affine mapping
+from physical coordinates to continuous voxel indices once and applies it to
+batches of points stored as x/y/z arrays. TrilinearSampler uses it to sample
+an image with trilinear interpolation: continuous indices of a batch are
+computed first, then clamped to buffer offsets and interpolation weights, and
+finally the eight neighboring voxel values of every point are gathered
+directly from the image buffer. No loop branches per point; points outside the
+image are masked with NaN after the arithmetic, so that the compiler
+vectorizes the loops (with -fno-trapping-math, see CMakeLists.txt); gathers
+are vectorized for 32 bit pixel types if offsets fit into an int.
+NearestNeighborSampler looks up the voxels containing a batch of points the
+same way, e.g. to transfer labels from labelmaps to mesh vertices and back.
+*/
+
+#ifndef lapdMouseImageSampler_h
+#define lapdMouseImageSampler_h
+
+// ITK includes
+#include <itkImage.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace lapdMouse
+{
+
+// affine transform from physical points to continuous voxel indices
+struct PhysicalToIndexTransform
+{
+  float matrix[9];
+  float offset[3];
+
+  PhysicalToIndexTransform()
+  {
+    std::fill(matrix, matrix+9, 0.0f);
+    std::fill(offset, offset+3, 0.0f);
+  }
+
+  template <typename TImage>
+  explicit PhysicalToIndexTransform(const TImage* image)
+  {
+    // index = M*(p-origin) = M*p - M*origin
+    const typename TImage::DirectionType& m = image->GetPhysicalPointToIndexMatrix();
+    const typename TImage::PointType& origin = image->GetOrigin();
+    for (unsigned int r=0; r<3; ++r)
+    {
+      double originIndex = 0;
+      for (unsigned int c=0; c<3; ++c)
+      {
+        matrix[r*3+c] = static_cast<float>(m[r][c]);
+        originIndex += m[r][c]*origin[c];
+      }
+      offset[r] = static_cast<float>(-originIndex);
+    }
+  }
+
+  // transform n points to continuous indices i/j/k
+  void TransformPoints(const float* x, const float* y, const float* z, size_t n,
+    float* i, float* j, float* k) const
+  {
+    const float m0 = matrix[0], m1 = matrix[1], m2 = matrix[2];
+    const float m3 = matrix[3], m4 = matrix[4], m5 = matrix[5];
+    const float m6 = matrix[6], m7 = matrix[7], m8 = matrix[8];
+    const float o0 = offset[0], o1 = offset[1], o2 = offset[2];
+    for (size_t p=0; p<n; ++p)
+    {
+      i[p] = m0*x[p]+m1*y[p]+m2*z[p]+o0;
+      j[p] = m3*x[p]+m4*y[p]+m5*z[p]+o1;
+      k[p] = m6*x[p]+m7*y[p]+m8*z[p]+o2;
+    }
+  }
+};
+
+// trilinear interpolation of an image at batches of physical points
+template <typename TImage>
+class TrilinearSampler
+{
+public:
+  using PixelType = typename TImage::PixelType;
+
+  explicit TrilinearSampler(const TImage* image) :
+    m_Transform(image),
+    m_Buffer(image->GetBufferPointer())
+  {
+    const typename TImage::RegionType& region = image->GetBufferedRegion();
+    for (unsigned int d=0; d<3; ++d)
+    {
+      m_Start[d] = static_cast<float>(region.GetIndex()[d]);
+      m_Size[d] = static_cast<long>(region.GetSize()[d]);
+      m_Max[d] = static_cast<float>(m_Size[d]-1);
+      m_Last[d] = static_cast<int>(std::max(m_Size[d]-2, 0L));
+    }
+    m_Stride[0] = 1;
+    m_Stride[1] = m_Size[0];
+    m_Stride[2] = m_Size[0]*m_Size[1];
+  }
+
+  const PhysicalToIndexTransform& GetTransform() const { return m_Transform; }
+
+  // sample n points; points outside the image are assigned NaN
+  void Sample(const float* x, const float* y, const float* z, size_t n,
+    float* values) const
+  {
+    if (m_Size[0]<2 || m_Size[1]<2 || m_Size[2]<2)
+    {
+      std::fill(values, values+n, std::numeric_limits<float>::quiet_NaN());
+      return;
+    }
+    if (m_Stride[2]*m_Size[2]<=std::numeric_limits<int>::max())
+      SampleBatches<int>(x, y, z, n, values);
+    else
+      SampleBatches<long>(x, y, z, n, values);
+  }
+
+private:
+  // TOffset is the type of buffer offsets; int allows gathers to be vectorized
+  template <typename TOffset>
+  void SampleBatches(const float* x, const float* y, const float* z, size_t n,
+    float* values) const
+  {
+    const size_t batchSize = 64;
+    float ci[batchSize], cj[batchSize], ck[batchSize];
+    TOffset offsets[batchSize];
+    int inside[batchSize];
+    float batchValues[batchSize];
+    for (size_t first=0; first<n; first+=batchSize)
+    {
+      const size_t count = std::min(batchSize, n-first);
+      m_Transform.TransformPoints(x+first, y+first, z+first, count, ci, cj, ck);
+      ComputeOffsets(count, ci, cj, ck, offsets, inside);
+      Interpolate(count, offsets, ci, cj, ck, inside, batchValues);
+      std::copy(batchValues, batchValues+count, values+first);
+    }
+  }
+
+  // clamp continuous indices i/j/k to the image, replace them by the
+  // interpolation weights and compute buffer offsets of the lower corner
+  // voxels; inside is 0 for points outside the image
+  template <typename TOffset>
+  void ComputeOffsets(size_t count, float* i, float* j, float* k,
+    TOffset* offsets, int* inside) const
+  {
+    const float startI = m_Start[0], startJ = m_Start[1], startK = m_Start[2];
+    const float maxI = m_Max[0], maxJ = m_Max[1], maxK = m_Max[2];
+    const int lastI = m_Last[0], lastJ = m_Last[1], lastK = m_Last[2];
+    const TOffset sj = static_cast<TOffset>(m_Stride[1]);
+    const TOffset sk = static_cast<TOffset>(m_Stride[2]);
+    for (size_t p=0; p<count; ++p)
+    {
+      const float pi = i[p]-startI, pj = j[p]-startJ, pk = k[p]-startK;
+      inside[p] = (pi>=0) & (pj>=0) & (pk>=0) & (pi<=maxI) & (pj<=maxJ) & (pk<=maxK);
+      // clamping in this order also maps NaN to 0
+      float ic = pi>0 ? pi : 0.0f, jc = pj>0 ? pj : 0.0f, kc = pk>0 ? pk : 0.0f;
+      ic = ic<maxI ? ic : maxI;
+      jc = jc<maxJ ? jc : maxJ;
+      kc = kc<maxK ? kc : maxK;
+      int i0 = static_cast<int>(ic), j0 = static_cast<int>(jc), k0 = static_cast<int>(kc);
+      i0 = i0<lastI ? i0 : lastI;
+      j0 = j0<lastJ ? j0 : lastJ;
+      k0 = k0<lastK ? k0 : lastK;
+      i[p] = ic-i0;
+      j[p] = jc-j0;
+      k[p] = kc-k0;
+      offsets[p] = i0+j0*sj+k0*sk;
+    }
+  }
+
+  // gather the eight voxels at offsets and interpolate with weights fi/fj/fk
+  template <typename TOffset>
+  void Interpolate(size_t count, const TOffset* offsets, const float* fi,
+    const float* fj, const float* fk, const int* inside, float* values) const
+  {
+    const PixelType* v = m_Buffer;
+    const TOffset sj = static_cast<TOffset>(m_Stride[1]);
+    const TOffset sk = static_cast<TOffset>(m_Stride[2]);
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    for (size_t p=0; p<count; ++p)
+    {
+      const TOffset o = offsets[p];
+      const float c00 = float(v[o])*(1-fi[p])+float(v[o+1])*fi[p];
+      const float c10 = float(v[o+sj])*(1-fi[p])+float(v[o+sj+1])*fi[p];
+      const float c01 = float(v[o+sk])*(1-fi[p])+float(v[o+sk+1])*fi[p];
+      const float c11 = float(v[o+sj+sk])*(1-fi[p])+float(v[o+sj+sk+1])*fi[p];
+      const float c0 = c00*(1-fj[p])+c10*fj[p];
+      const float c1 = c01*(1-fj[p])+c11*fj[p];
+      const float value = c0*(1-fk[p])+c1*fk[p];
+      values[p] = inside[p] ? value : nan;
+    }
+  }
+
+  PhysicalToIndexTransform m_Transform;
+  const PixelType* m_Buffer;
+  float m_Start[3];
+  long m_Size[3];
+  long m_Stride[3];
+  float m_Max[3]; // largest continuous index inside the image
+  int m_Last[3]; // largest index of a lower corner voxel
+};
+
+// nearest neighbor lookup of an image, e.g. a labelmap, at batches of
+// physical points
+template <typename TImage>
+class NearestNeighborSampler
+{
+public:
+  using PixelType = typename TImage::PixelType;
+
+  explicit NearestNeighborSampler(const TImage* image) :
+    m_Transform(image),
+    m_Buffer(image->GetBufferPointer())
+  {
+    const typename TImage::RegionType& region = image->GetBufferedRegion();
+    for (unsigned int d=0; d<3; ++d)
+    {
+      m_Start[d] = static_cast<float>(region.GetIndex()[d]);
+      m_Size[d] = static_cast<long>(region.GetSize()[d]);
+      m_Spacing[d] = static_cast<float>(image->GetSpacing()[d]);
+    }
+    m_Stride[0] = 1;
+    m_Stride[1] = m_Size[0];
+    m_Stride[2] = m_Size[0]*m_Size[1];
+  }
+
+  const PhysicalToIndexTransform& GetTransform() const { return m_Transform; }
+
+  // compute buffer offsets of the voxels containing n points; points outside
+  // the image are assigned -1
+  void ComputeOffsets(const float* x, const float* y, const float* z, size_t n,
+    long* offsets) const
+  {
+    const size_t batchSize = 64;
+    float ci[batchSize], cj[batchSize], ck[batchSize];
+    for (size_t first=0; first<n; first+=batchSize)
+    {
+      const size_t count = std::min(batchSize, n-first);
+      m_Transform.TransformPoints(x+first, y+first, z+first, count, ci, cj, ck);
+      for (size_t p=0; p<count; ++p)
+      {
+        const long i = static_cast<long>(std::floor(ci[p]-m_Start[0]+0.5f));
+        const long j = static_cast<long>(std::floor(cj[p]-m_Start[1]+0.5f));
+        const long k = static_cast<long>(std::floor(ck[p]-m_Start[2]+0.5f));
+        const bool inside = i>=0 && j>=0 && k>=0 &&
+          i<m_Size[0] && j<m_Size[1] && k<m_Size[2];
+        offsets[first+p] = inside ? i+j*m_Stride[1]+k*m_Stride[2] : -1;
+      }
+    }
+  }
+
+  // sample n points; points outside the image are assigned 0; if
+  // searchRadius (in physical units) is positive, points on a zero voxel are
+  // assigned the value of the closest nonzero voxel within searchRadius
+  void Sample(const float* x, const float* y, const float* z, size_t n,
+    PixelType* values, float searchRadius=0) const
+  {
+    const size_t batchSize = 64;
+    long offsets[batchSize];
+    float ci[batchSize], cj[batchSize], ck[batchSize];
+    for (size_t first=0; first<n; first+=batchSize)
+    {
+      const size_t count = std::min(batchSize, n-first);
+      ComputeOffsets(x+first, y+first, z+first, count, offsets);
+      for (size_t p=0; p<count; ++p)
+        values[first+p] = offsets[p]>=0 ? m_Buffer[offsets[p]] : PixelType(0);
+      if (searchRadius<=0)
+        continue;
+      m_Transform.TransformPoints(x+first, y+first, z+first, count, ci, cj, ck);
+      for (size_t p=0; p<count; ++p)
+        if (values[first+p]==PixelType(0))
+          values[first+p] = SearchNonzero(ci[p]-m_Start[0], cj[p]-m_Start[1],
+            ck[p]-m_Start[2], searchRadius);
+    }
+  }
+
+private:
+  // value of the closest nonzero voxel within radius of continuous index
+  // i/j/k; ties are resolved in favor of the first voxel in buffer order
+  PixelType SearchNonzero(float i, float j, float k, float radius) const
+  {
+    const float index[3] = { i, j, k };
+    long lower[3], upper[3];
+    for (unsigned int d=0; d<3; ++d)
+    {
+      const float extent = radius/m_Spacing[d];
+      lower[d] = std::max(0L, static_cast<long>(std::ceil(index[d]-extent)));
+      upper[d] = std::min(m_Size[d]-1, static_cast<long>(std::floor(index[d]+extent)));
+      if (lower[d]>upper[d])
+        return PixelType(0);
+    }
+    PixelType value = PixelType(0);
+    float closestDistance2 = radius*radius;
+    for (long vk=lower[2]; vk<=upper[2]; ++vk)
+    {
+      const float dk = (vk-k)*m_Spacing[2];
+      for (long vj=lower[1]; vj<=upper[1]; ++vj)
+      {
+        const float dj = (vj-j)*m_Spacing[1];
+        const PixelType* row = m_Buffer+vj*m_Stride[1]+vk*m_Stride[2];
+        for (long vi=lower[0]; vi<=upper[0]; ++vi)
+        {
+          if (row[vi]==PixelType(0))
+            continue;
+          const float di = (vi-i)*m_Spacing[0];
+          const float distance2 = di*di+dj*dj+dk*dk;
+          if (distance2<closestDistance2 ||
+            (distance2==closestDistance2 && value==PixelType(0)))
+          {
+            closestDistance2 = distance2;
+            value = row[vi];
+          }
+        }
+      }
+    }
+    return value;
+  }
+
+  PhysicalToIndexTransform m_Transform;
+  const PixelType* m_Buffer;
+  float m_Start[3];
+  long m_Size[3];
+  long m_Stride[3];
+  float m_Spacing[3];
+};
+
+} // namespace lapdMouse
+
+#endif
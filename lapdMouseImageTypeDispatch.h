@@ -0,0 +1,85 @@
+/*
+Helpers to process images with the pixel type they are stored with on disk.
+
+ReadComponentType only reads the header of an image file. DispatchOnPixelType
+uses it to call a generic functor with a PixelTypeTag of the file's native
+pixel type, so the processing code gets instantiated for every supported type
+at compile time and the image is never converted on reading, e.g.:
+
+```c++
+lapdMouse::DispatchOnPixelType( filename, [&](auto tag)
+{
+  using PixelType = typename decltype(tag)::Type;
+  using ImageType = itk::Image< PixelType, 3 >;
+  // ... read and process ImageType
+});
+```
+*/
+
+#ifndef lapdMouseImageTypeDispatch_h
+#define lapdMouseImageTypeDispatch_h
+
+// ITK includes
+#include <itkImageIOBase.h>
+#include <itkImageIOFactory.h>
+#include <itkMacro.h>
+
+#include <string>
+
+namespace lapdMouse
+{
+
+// empty tag type used to pass a pixel type to a generic functor
+template <typename TPixel>
+struct PixelTypeTag
+{
+  using Type = TPixel;
+};
+
+// read component type stored in an image file's header
+inline itk::IOComponentEnum ReadComponentType(const std::string& filename)
+{
+  itk::ImageIOBase::Pointer imageIO = itk::ImageIOFactory::CreateImageIO(
+    filename.c_str(), itk::IOFileModeEnum::ReadMode );
+  if (imageIO.IsNull())
+    itkGenericExceptionMacro( "unable to find image reader for " << filename );
+  imageIO->SetFileName( filename );
+  imageIO->ReadImageInformation();
+  if (imageIO->GetNumberOfComponents()!=1)
+    itkGenericExceptionMacro( "only scalar images are supported: " << filename );
+  return imageIO->GetComponentType();
+}
+
+// call functor with PixelTypeTag<T>, where T is the file's native pixel type
+template <typename TFunctor>
+void DispatchOnPixelType(const std::string& filename, TFunctor&& functor)
+{
+  const itk::IOComponentEnum componentType = ReadComponentType( filename );
+  switch (componentType)
+  {
+    case itk::IOComponentEnum::UCHAR:
+      functor( PixelTypeTag<unsigned char>() ); break;
+    case itk::IOComponentEnum::CHAR:
+      functor( PixelTypeTag<char>() ); break;
+    case itk::IOComponentEnum::USHORT:
+      functor( PixelTypeTag<unsigned short>() ); break;
+    case itk::IOComponentEnum::SHORT:
+      functor( PixelTypeTag<short>() ); break;
+    case itk::IOComponentEnum::UINT:
+      functor( PixelTypeTag<unsigned int>() ); break;
+    case itk::IOComponentEnum::INT:
+      functor( PixelTypeTag<int>() ); break;
+    case itk::IOComponentEnum::FLOAT:
+      functor( PixelTypeTag<float>() ); break;
+    case itk::IOComponentEnum::DOUBLE:
+      functor( PixelTypeTag<double>() ); break;
+    default:
+      itkGenericExceptionMacro( "unsupported pixel type "
+        << itk::ImageIOBase::GetComponentTypeAsString( componentType )
+        << " in " << filename );
+  }
+}
+
+} // namespace lapdMouse
+
+#endif
@@ -0,0 +1,518 @@
+/*
+Helpers to read airway trees stored in the Java Script Object Notation (JSON)
+format written by metaTree2JsonConverter.
+
+ReadJsonTree parses the file in a single pass without building a document
+tree: IDs, names, and child lists of segments are collected while parsing and
+centerline coordinates and radii are appended directly to the contiguous arrays
+of a TreeSegments structure (see lapdMouseTreeSegments.h). Parent/child
+consistency is verified along the way: each segment may only be listed as
+child of one segment, all children have to exist, all segments need to be
+reachable from a root segment, and a segment's ParentID (if given) has to
+match the segment listing it as child. Violations are reported as
+itk::ExceptionObject. The ParentID of root segments is the ID of the enclosing
+group; it is -1 if not given.
+
+BuildSpatialObjectTree converts the result into the hierarchy of
+TubeSpatialObjects used for AirwayTree.meta, which can then get written with a
+SpatialObjectWriter. Segments are connected to the parent's centerline point
+given by ParentPoint; files written before ParentPoint was stored lack this
+key, in which case the parent's centerline point closest to the segment's
+start is used instead.
+*/
+
+#ifndef lapdMouseJsonTreeReader_h
+#define lapdMouseJsonTreeReader_h
+
+// ITK includes
+#include <itkGroupSpatialObject.h>
+#include <itkMacro.h>
+#include <itkTubeSpatialObject.h>
+#include "lapdMouseTreeSegments.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace lapdMouse
+{
+
+// single pass parser for the JSON tree format of metaTree2JsonConverter
+class JsonTreeParser
+{
+public:
+  explicit JsonTreeParser(const std::string& filename) : m_Filename(filename), m_Position(0)
+  {
+    std::ifstream infile( filename.c_str(), std::ios::binary );
+    if (!infile.good())
+      itkGenericExceptionMacro( "unable to read " << filename );
+    infile.seekg(0, std::ios::end);
+    m_Text.resize(size_t(infile.tellg()));
+    infile.seekg(0, std::ios::beg);
+    infile.read(&m_Text[0], m_Text.size());
+  }
+
+  TreeSegments Parse()
+  {
+    // segments are collected in file order and sorted by ID afterwards
+    SkipWhitespace();
+    Expect('[');
+    SkipWhitespace();
+    if (Peek()!=']')
+    {
+      do
+      {
+        ParseSegment();
+        SkipWhitespace();
+      } while (Accept(','));
+    }
+    Expect(']');
+    SkipWhitespace();
+    if (m_Position!=m_Text.size())
+      Fail("unexpected data after end of segment list");
+    return BuildSegments();
+  }
+
+private:
+  struct ParsedSegment
+  {
+    unsigned int id = 0;
+    bool hasId = false;
+    int parentId = -1;
+    bool hasParentId = false;
+    int parentPoint = -1;
+    std::string name;
+    size_t firstChild = 0;
+    size_t numberOfChildren = 0;
+    size_t firstPoint = 0;
+    size_t numberOfPoints = 0;
+    size_t numberOfRadii = 0;
+  };
+
+  void ParseSegment()
+  {
+    ParsedSegment segment;
+    segment.firstChild = m_Children.size();
+    segment.firstPoint = m_X.size();
+    const size_t firstRadius = m_Radius.size();
+    SkipWhitespace();
+    Expect('{');
+    SkipWhitespace();
+    if (Peek()!='}')
+    {
+      do
+      {
+        SkipWhitespace();
+        const std::string key = ParseString();
+        SkipWhitespace();
+        Expect(':');
+        SkipWhitespace();
+        if (key=="ID")
+        {
+          segment.id = ParseUnsigned();
+          segment.hasId = true;
+        }
+        else if (key=="ParentID")
+        {
+          segment.parentId = ParseInteger();
+          segment.hasParentId = true;
+        }
+        else if (key=="ParentPoint")
+          segment.parentPoint = ParseInteger();
+        else if (key=="Name")
+          segment.name = ParseString();
+        else if (key=="Children")
+          ParseArray([&]() { m_Children.push_back(ParseUnsigned()); });
+        else if (key=="Coordinates")
+          ParseArray([&]()
+          {
+            Expect('[');
+            SkipWhitespace(); m_X.push_back(ParseFloat()); SkipWhitespace(); Expect(',');
+            SkipWhitespace(); m_Y.push_back(ParseFloat()); SkipWhitespace(); Expect(',');
+            SkipWhitespace(); m_Z.push_back(ParseFloat()); SkipWhitespace();
+            Expect(']');
+          });
+        else if (key=="Radii")
+          ParseArray([&]() { m_Radius.push_back(ParseFloat()); });
+        else
+          SkipValue();
+        SkipWhitespace();
+      } while (Accept(','));
+    }
+    Expect('}');
+
+    segment.numberOfChildren = m_Children.size()-segment.firstChild;
+    segment.numberOfPoints = m_X.size()-segment.firstPoint;
+    segment.numberOfRadii = m_Radius.size()-firstRadius;
+    if (!segment.hasId)
+      Fail("segment without ID");
+    if (segment.numberOfPoints!=segment.numberOfRadii)
+      Fail("number of coordinates and radii differ for segment "+std::to_string(segment.id));
+    if (!m_SegmentIndices.insert(std::make_pair(segment.id, m_Segments.size())).second)
+      Fail("duplicate segment ID "+std::to_string(segment.id));
+
+    // each segment may only have one parent
+    for (size_t c=segment.firstChild; c<m_Children.size(); ++c)
+      if (!m_ParentIds.insert(std::make_pair(m_Children[c], segment.id)).second)
+        Fail("segment "+std::to_string(m_Children[c])+" is child of segments "+
+          std::to_string(m_ParentIds[m_Children[c]])+" and "+std::to_string(segment.id));
+    m_Segments.push_back(segment);
+  }
+
+  // reorder segments by ID and verify that children exist and all segments
+  // are reachable from a root segment
+  TreeSegments BuildSegments()
+  {
+    std::vector<size_t> order(m_Segments.size());
+    for (size_t i=0; i<order.size(); ++i)
+      order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+      { return m_Segments[a].id<m_Segments[b].id; });
+
+    TreeSegments result;
+    std::unordered_map<unsigned int, int> segmentIndices;
+    for (size_t i=0; i<order.size(); ++i)
+    {
+      result.ids.push_back(m_Segments[order[i]].id);
+      segmentIndices[m_Segments[order[i]].id] = int(i);
+    }
+    result.parents.assign(order.size(), -1);
+    result.parentIds.resize(order.size());
+    result.parentPoints.resize(order.size());
+    for (size_t i=0; i<order.size(); ++i)
+    {
+      result.parentIds[i] = m_Segments[order[i]].parentId;
+      result.parentPoints[i] = m_Segments[order[i]].parentPoint;
+    }
+    for (std::unordered_map<unsigned int, unsigned int>::const_iterator it=m_ParentIds.begin();
+      it!=m_ParentIds.end(); ++it)
+    {
+      std::unordered_map<unsigned int, int>::const_iterator child = segmentIndices.find(it->first);
+      if (child==segmentIndices.end())
+        itkGenericExceptionMacro( "child " << it->first << " of segment " << it->second
+          << " does not exist in " << m_Filename );
+      if (m_Segments[order[child->second]].hasParentId &&
+        result.parentIds[child->second]!=int(it->second))
+        itkGenericExceptionMacro( "segment " << it->first << " has ParentID "
+          << result.parentIds[child->second] << " but is child of segment "
+          << it->second << " in " << m_Filename );
+      result.parents[child->second] = segmentIndices[it->second];
+      result.parentIds[child->second] = int(it->second);
+    }
+
+    // every segment has to be reachable from a root; otherwise the child
+    // lists contain a cycle
+    std::vector<size_t> reachable;
+    for (size_t i=0; i<order.size(); ++i)
+      if (result.parents[i]<0)
+        reachable.push_back(i);
+    for (size_t r=0; r<reachable.size(); ++r)
+    {
+      const ParsedSegment& segment = m_Segments[order[reachable[r]]];
+      for (size_t c=segment.firstChild; c<segment.firstChild+segment.numberOfChildren; ++c)
+        reachable.push_back(segmentIndices[m_Children[c]]);
+    }
+    if (reachable.size()!=order.size())
+      itkGenericExceptionMacro( "child lists contain a cycle in " << m_Filename );
+
+    result.x.reserve(m_X.size());
+    result.y.reserve(m_Y.size());
+    result.z.reserve(m_Z.size());
+    result.radius.reserve(m_Radius.size());
+    result.pointOffsets.push_back(0);
+    for (size_t i=0; i<order.size(); ++i)
+    {
+      const ParsedSegment& segment = m_Segments[order[i]];
+      result.names.push_back(segment.name);
+      const size_t first = segment.firstPoint;
+      const size_t last = first+segment.numberOfPoints;
+      result.x.insert(result.x.end(), m_X.begin()+first, m_X.begin()+last);
+      result.y.insert(result.y.end(), m_Y.begin()+first, m_Y.begin()+last);
+      result.z.insert(result.z.end(), m_Z.begin()+first, m_Z.begin()+last);
+      result.radius.insert(result.radius.end(), m_Radius.begin()+first, m_Radius.begin()+last);
+      result.pointOffsets.push_back(result.x.size());
+    }
+    ComputeChildren(result);
+    return result;
+  }
+
+  template <typename TElementParser>
+  void ParseArray(TElementParser parseElement)
+  {
+    Expect('[');
+    SkipWhitespace();
+    if (Accept(']'))
+      return;
+    do
+    {
+      SkipWhitespace();
+      parseElement();
+      SkipWhitespace();
+    } while (Accept(','));
+    Expect(']');
+  }
+
+  std::string ParseString()
+  {
+    Expect('"');
+    std::string value;
+    while (m_Position<m_Text.size() && m_Text[m_Position]!='"')
+    {
+      char c = m_Text[m_Position++];
+      if (c=='\\')
+      {
+        if (m_Position>=m_Text.size())
+          break;
+        c = m_Text[m_Position++];
+        switch (c)
+        {
+          case 'b': c = '\b'; break;
+          case 'f': c = '\f'; break;
+          case 'n': c = '\n'; break;
+          case 'r': c = '\r'; break;
+          case 't': c = '\t'; break;
+          case 'u':
+          {
+            // encode code point of basic multilingual plane as UTF-8
+            if (m_Position+4>m_Text.size())
+              Fail("invalid unicode escape");
+            const unsigned long codePoint = strtoul(m_Text.substr(m_Position, 4).c_str(), nullptr, 16);
+            m_Position += 4;
+            if (codePoint<0x80)
+              value += char(codePoint);
+            else if (codePoint<0x800)
+            {
+              value += char(0xC0 | (codePoint>>6));
+              value += char(0x80 | (codePoint & 0x3F));
+            }
+            else
+            {
+              value += char(0xE0 | (codePoint>>12));
+              value += char(0x80 | ((codePoint>>6) & 0x3F));
+              value += char(0x80 | (codePoint & 0x3F));
+            }
+            continue;
+          }
+          default: break; // '"', '\\', '/'
+        }
+      }
+      value += c;
+    }
+    Expect('"');
+    return value;
+  }
+
+  float ParseFloat()
+  {
+    const char* begin = m_Text.c_str()+m_Position;
+    char* end;
+    const double value = strtod(begin, &end);
+    if (end==begin)
+      Fail("number expected");
+    m_Position += end-begin;
+    return float(value);
+  }
+
+  int ParseInteger()
+  {
+    const char* begin = m_Text.c_str()+m_Position;
+    char* end;
+    const long value = strtol(begin, &end, 10);
+    if (end==begin || value<std::numeric_limits<int>::min() ||
+      value>std::numeric_limits<int>::max())
+      Fail("integer expected");
+    m_Position += end-begin;
+    return static_cast<int>(value);
+  }
+
+  unsigned int ParseUnsigned()
+  {
+    const char* begin = m_Text.c_str()+m_Position;
+    char* end;
+    const unsigned long value = strtoul(begin, &end, 10);
+    if (end==begin || value>std::numeric_limits<unsigned int>::max())
+      Fail("segment ID expected");
+    m_Position += end-begin;
+    return static_cast<unsigned int>(value);
+  }
+
+  // skip value of an unknown key
+  void SkipValue()
+  {
+    const char c = Peek();
+    if (c=='"')
+      ParseString();
+    else if (c=='[' || c=='{')
+    {
+      const char close = c=='[' ? ']' : '}';
+      ++m_Position;
+      SkipWhitespace();
+      if (Accept(close))
+        return;
+      do
+      {
+        SkipWhitespace();
+        if (close=='}')
+        {
+          ParseString();
+          SkipWhitespace();
+          Expect(':');
+          SkipWhitespace();
+        }
+        SkipValue();
+        SkipWhitespace();
+      } while (Accept(','));
+      Expect(close);
+    }
+    else
+    {
+      // number, true, false, null
+      while (m_Position<m_Text.size() && m_Text[m_Position]!=',' &&
+        m_Text[m_Position]!='}' && m_Text[m_Position]!=']' &&
+        !isspace(static_cast<unsigned char>(m_Text[m_Position])))
+        ++m_Position;
+    }
+  }
+
+  void SkipWhitespace()
+  {
+    while (m_Position<m_Text.size() && isspace(static_cast<unsigned char>(m_Text[m_Position])))
+      ++m_Position;
+  }
+
+  char Peek() const
+  {
+    return m_Position<m_Text.size() ? m_Text[m_Position] : '\0';
+  }
+
+  bool Accept(char c)
+  {
+    if (Peek()!=c)
+      return false;
+    ++m_Position;
+    return true;
+  }
+
+  void Expect(char c)
+  {
+    if (!Accept(c))
+      Fail(std::string("'")+c+"' expected");
+  }
+
+  void Fail(const std::string& message) const
+  {
+    const size_t line = 1+std::count(m_Text.begin(), m_Text.begin()+
+      std::min(m_Position, m_Text.size()), '\n');
+    itkGenericExceptionMacro( m_Filename << ":" << line << ": " << message );
+  }
+
+  std::string m_Filename;
+  std::string m_Text;
+  size_t m_Position;
+  std::vector<ParsedSegment> m_Segments;
+  std::unordered_map<unsigned int, size_t> m_SegmentIndices;
+  std::unordered_map<unsigned int, unsigned int> m_ParentIds; // child -> parent
+  std::vector<unsigned int> m_Children;
+  std::vector<float> m_X;
+  std::vector<float> m_Y;
+  std::vector<float> m_Z;
+  std::vector<float> m_Radius;
+};
+
+// read JSON tree into contiguous arrays
+inline TreeSegments ReadJsonTree(const std::string& filename)
+{
+  JsonTreeParser parser( filename );
+  return parser.Parse();
+}
+
+// create hierarchy of TubeSpatialObjects as stored in AirwayTree.meta; each
+// segment is connected to its parent's centerline point given by parentPoints
+// or, if unknown, to the parent's centerline point closest to its start; the
+// enclosing group gets the parent ID of the (first) root segment
+inline itk::GroupSpatialObject<3>::Pointer BuildSpatialObjectTree(const TreeSegments& segments)
+{
+  using GroupType = itk::GroupSpatialObject<3>;
+  using TubeType = itk::TubeSpatialObject<3>;
+  GroupType::Pointer tree = GroupType::New();
+
+  const size_t numberOfSegments = segments.GetNumberOfSegments();
+  tree->SetId(-1);
+  for (size_t s=0; s<numberOfSegments; ++s)
+    if (segments.parents[s]<0)
+    {
+      tree->SetId(segments.parentIds[s]);
+      break;
+    }
+
+  std::vector<TubeType::Pointer> tubes(numberOfSegments);
+  for (size_t s=0; s<numberOfSegments; ++s)
+  {
+    TubeType::Pointer tube = TubeType::New();
+    tube->SetTypeName("VesselTubeSpatialObject");
+    tube->SetId(int(segments.ids[s]));
+    tube->GetProperty().SetName(segments.names[s]);
+    TubeType::TubePointListType points;
+    for (size_t p=segments.pointOffsets[s]; p<segments.pointOffsets[s+1]; ++p)
+    {
+      TubeType::TubePointType point;
+      TubeType::TubePointType::PointType position;
+      position[0] = segments.x[p];
+      position[1] = segments.y[p];
+      position[2] = segments.z[p];
+      point.SetPositionInObjectSpace(position);
+      point.SetRadiusInObjectSpace(segments.radius[p]);
+      points.push_back(point);
+    }
+    tube->SetPoints(points);
+    tube->ComputeTangentsAndNormals();
+    tubes[s] = tube;
+  }
+
+  for (size_t s=0; s<numberOfSegments; ++s)
+  {
+    const int parent = segments.parents[s];
+    if (parent<0)
+    {
+      tree->AddChild(tubes[s]);
+      continue;
+    }
+    // connection point is the stored one or parent's centerline point
+    // closest to segment start
+    int parentPoint = segments.parentPoints[s];
+    if (parentPoint<0 || parentPoint>=int(segments.GetNumberOfPoints(parent)))
+      parentPoint = int(segments.GetNumberOfPoints(parent))-1;
+    if (segments.parentPoints[s]<0 && segments.GetNumberOfPoints(s)>0)
+    {
+      const size_t start = segments.pointOffsets[s];
+      float closestDistance = std::numeric_limits<float>::max();
+      for (size_t p=segments.pointOffsets[parent]; p<segments.pointOffsets[parent+1]; ++p)
+      {
+        const float dx = segments.x[p]-segments.x[start];
+        const float dy = segments.y[p]-segments.y[start];
+        const float dz = segments.z[p]-segments.z[start];
+        const float distance = dx*dx+dy*dy+dz*dz;
+        if (distance<closestDistance)
+        {
+          closestDistance = distance;
+          parentPoint = int(p-segments.pointOffsets[parent]);
+        }
+      }
+    }
+    tubes[s]->SetParentPoint(parentPoint);
+    tubes[parent]->AddChild(tubes[s]);
+  }
+  tree->Update();
+
+  return tree;
+}
+
+} // namespace lapdMouse
+
+#endif
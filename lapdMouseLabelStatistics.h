@@ -0,0 +1,127 @@
+/*
+Helper to calculate statistical measurements for labeled regions of an
+intensity image, as output by imageLabelStatistics.
+
+WriteLabelStatistics reads an intensity image and a labelmap, resamples the
+labelmap to the resolution of the intensity image, and writes for each
+labeled region volume, average gray-value, etc. in a Comma Separated Value
+(CSV) format to a stream. The intensity image and labelmap are processed with
+the pixel types they are stored with on disk. Labelmaps stored as dense
+ordinals (e.g. TerminalCompartments.nrrd) are reported with their original
+labels.
+*/
+
+#ifndef lapdMouseLabelStatistics_h
+#define lapdMouseLabelStatistics_h
+
+// ITK includes
+#include <itkImage.h>
+#include <itkResampleImageFilter.h>
+#include <itkNearestNeighborInterpolateImageFunction.h>
+#include <itkLabelStatisticsImageFilter.h>
+#include "lapdMouseAsyncReader.h"
+#include "lapdMouseImageTypeDispatch.h"
+#include "lapdMouseCompactLabelmap.h"
+
+#include <ostream>
+#include <string>
+
+namespace lapdMouse
+{
+
+// the histogram is required for median calculation; it's accuracy is limited
+// to the binwidth of the histogram
+const unsigned int LabelStatisticsHistogramBins = 20000;
+const double LabelStatisticsHistogramMinimum = -20000;
+const double LabelStatisticsHistogramMaximum = 20000;
+
+// calculate label statistics for an intensity image with pixel type TPixel
+// and a labelmap with pixel type TLabel and write them to stream as CSV
+template <typename TPixel, typename TLabel>
+void WriteLabelStatistics(const std::string& imageFilename,
+  const std::string& labelMapFilename, std::ostream& stream)
+{
+  // define types
+  typedef itk::Image<TPixel, 3> ImageType;
+  typedef itk::Image<TLabel, 3> LabelMapType;
+  typedef itk::LabelStatisticsImageFilter<ImageType, LabelMapType> LabelStatisticsImageFilterType;
+
+  // start reading intensity image and labelmap concurrently
+  std::future<typename ImageType::Pointer> imageFuture =
+    ReadImageAsync<ImageType>( imageFilename );
+  std::future<typename LabelMapType::Pointer> labelMapFuture =
+    ReadImageAsync<LabelMapType>( labelMapFilename );
+  typename ImageType::Pointer intensityImage = imageFuture.get();
+
+  // resample labelmap to resolution of intensity image
+  typedef itk::ResampleImageFilter< LabelMapType, LabelMapType > ResampleFilterType;
+  typename ResampleFilterType::Pointer resampler = ResampleFilterType::New();
+  resampler->SetInput( labelMapFuture.get() );
+  resampler->SetOutputParametersFromImage( intensityImage );
+  resampler->SetInterpolator( itk::NearestNeighborInterpolateImageFunction< LabelMapType, double >::New() );
+  resampler->SetDefaultPixelValue( 0 );
+  resampler->Update();
+  typename LabelMapType::Pointer labelMap = resampler->GetOutput();
+
+  // table to translate ordinals of compactly stored labelmaps to labels
+  CompactLabelTable labelTable = ReadLabelTable( labelMapFilename );
+
+  // region statistics information
+  typename LabelStatisticsImageFilterType::Pointer labelStatistics = LabelStatisticsImageFilterType::New();
+  labelStatistics->SetInput( intensityImage );
+  labelStatistics->SetLabelInput( labelMap );
+  labelStatistics->SetHistogramParameters( LabelStatisticsHistogramBins,
+    LabelStatisticsHistogramMinimum, LabelStatisticsHistogramMaximum );
+  labelStatistics->Update();
+
+  typename LabelMapType::SpacingType spacing = labelMap->GetSpacing();
+  double voxelVolume = spacing[0]*spacing[1]*spacing[2];
+
+  typedef typename LabelStatisticsImageFilterType::ValidLabelValuesContainerType ValidLabelValuesType;
+  typedef typename LabelStatisticsImageFilterType::LabelPixelType                LabelPixelType;
+
+  // print header
+  stream << "label,volume,mean,sigma,median,min,max,count" << std::endl;
+
+  for(typename ValidLabelValuesType::const_iterator vIt=labelStatistics->GetValidLabelValues().begin();
+      vIt != labelStatistics->GetValidLabelValues().end(); ++vIt)
+  {
+    if ( labelStatistics->HasLabel(*vIt) )
+    {
+      LabelPixelType labelValue = *vIt;
+      if (labelValue==0)
+        continue;
+
+      stream << labelTable.GetLabel( labelValue ) << ",";
+      stream << labelStatistics->GetCount(labelValue)*voxelVolume << ",";
+      stream << labelStatistics->GetMean( labelValue ) << ",";
+      stream << labelStatistics->GetSigma( labelValue ) << ",";
+      stream << labelStatistics->GetMedian( labelValue ) << ",";
+      stream << labelStatistics->GetMinimum( labelValue ) << ",";
+      stream << labelStatistics->GetMaximum( labelValue ) << ",";
+      stream << labelStatistics->GetCount( labelValue );
+      stream << std::endl;
+    }
+  }
+}
+
+// calculate label statistics and write them to stream as CSV; the
+// calculation is instantiated for the pixel types of intensity image and
+// labelmap, so that no per-voxel conversion is needed
+inline void WriteLabelStatistics(const std::string& imageFilename,
+  const std::string& labelMapFilename, std::ostream& stream)
+{
+  DispatchOnPixelType( imageFilename, [&](auto imageTag)
+  {
+    using PixelType = typename decltype(imageTag)::Type;
+    DispatchOnLabelPixelType( labelMapFilename, [&](auto labelTag)
+    {
+      using LabelType = typename decltype(labelTag)::Type;
+      WriteLabelStatistics<PixelType, LabelType>( imageFilename, labelMapFilename, stream );
+    });
+  });
+}
+
+} // namespace lapdMouse
+
+#endif
@@ -0,0 +1,425 @@
+/*
+Helpers to skip recomputation of outputs whose inputs did not change.
+
+A StageCache computes a key from the tool's name and build, the content of
+all input files, and all parameters affecting the output. Outputs are stored
+in a cache directory under this key; if a tool is run again with the same
+key, the stored outputs are reused instead of recomputed, e.g.:
+
+```c++
+lapdMouse::StageCache cache( "simplifyTree" );
+cache.AddInputFile( inputFilename );
+cache.AddParameter( "morphometry", morphometryColumns );
+if (cache.Restore( "table", outputFilename ))
+  return EXIT_SUCCESS;
+// ... compute output
+cache.Store( "table", outputFilename );
+```
+
+Caching is enabled by setting the environment variable LAPDMOUSE_CACHE_DIR
+to an existing directory. Input files are hashed through a memory mapping
+with a 64-bit hash compatible with xxHash64, so a cache hit only costs reading
+the inputs once. For inputs with detached pixel data (.mhd and .nhdr headers),
+the data file is hashed along with the header; headers referencing lists or
+patterns of data files disable the cache. Outputs in these formats are not
+cached, as a restored header would reference the data file of the run that
+stored it.
+*/
+
+#ifndef lapdMouseStageCache_h
+#define lapdMouseStageCache_h
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// identifies the build of a tool; CMakeLists.txt generates a header defining
+// it from a hash of the tool's sources and the ITK version on every build.
+// Outputs of other builds are not reused. Without a build ID, outputs of
+// different builds cannot be told apart and caching is disabled.
+#ifdef LAPDMOUSE_BUILD_ID_HEADER
+#include LAPDMOUSE_BUILD_ID_HEADER
+#endif
+#ifndef LAPDMOUSE_BUILD_ID
+#define LAPDMOUSE_BUILD_ID ""
+#endif
+
+namespace lapdMouse
+{
+
+// streaming 64-bit hash compatible with xxHash64
+class Hasher
+{
+public:
+  explicit Hasher(uint64_t seed=0) : m_TotalLength(0), m_BufferSize(0)
+  {
+    m_State[0] = seed+Prime1+Prime2;
+    m_State[1] = seed+Prime2;
+    m_State[2] = seed;
+    m_State[3] = seed-Prime1;
+    m_Seed = seed;
+  }
+
+  void Update(const void* data, size_t size)
+  {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    m_TotalLength += size;
+    if (m_BufferSize>0)
+    {
+      const size_t count = std::min(size, size_t(32)-m_BufferSize);
+      memcpy(m_Buffer+m_BufferSize, p, count);
+      m_BufferSize += count;
+      p += count;
+      size -= count;
+      if (m_BufferSize<32)
+        return;
+      ProcessStripe(m_Buffer);
+      m_BufferSize = 0;
+    }
+    for (; size>=32; p+=32, size-=32)
+      ProcessStripe(p);
+    memcpy(m_Buffer, p, size);
+    m_BufferSize = size;
+  }
+
+  void Update(const std::string& text)
+  {
+    // include length, so that consecutive strings are separated
+    const uint64_t length = text.size();
+    Update(&length, sizeof(length));
+    Update(text.data(), text.size());
+  }
+
+  // hash content of a file; returns false if the file cannot be read
+  bool UpdateFile(const std::string& filename)
+  {
+#if !defined(_WIN32)
+    int file = open(filename.c_str(), O_RDONLY);
+    if (file<0)
+      return false;
+    struct stat fileStatus;
+    if (fstat(file, &fileStatus)!=0)
+    {
+      close(file);
+      return false;
+    }
+    const size_t size = size_t(fileStatus.st_size);
+    Update(&size, sizeof(size));
+    if (size>0)
+    {
+      void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+      if (data==MAP_FAILED)
+      {
+        close(file);
+        return false;
+      }
+      madvise(data, size, MADV_SEQUENTIAL);
+      Update(data, size);
+      munmap(data, size);
+    }
+    close(file);
+    return true;
+#else
+    std::ifstream infile( filename.c_str(), std::ios::binary );
+    if (!infile.good())
+      return false;
+    infile.seekg(0, std::ios::end);
+    const size_t size = size_t(infile.tellg());
+    infile.seekg(0, std::ios::beg);
+    Update(&size, sizeof(size));
+    std::vector<char> buffer(1<<20);
+    while (infile.read(buffer.data(), buffer.size()) || infile.gcount()>0)
+      Update(buffer.data(), size_t(infile.gcount()));
+    return true;
+#endif
+  }
+
+  uint64_t GetDigest() const
+  {
+    uint64_t h;
+    if (m_TotalLength>=32)
+    {
+      h = RotateLeft(m_State[0], 1)+RotateLeft(m_State[1], 7)+
+        RotateLeft(m_State[2], 12)+RotateLeft(m_State[3], 18);
+      for (unsigned int i=0; i<4; ++i)
+      {
+        h ^= Round(0, m_State[i]);
+        h = h*Prime1+Prime4;
+      }
+    }
+    else
+      h = m_Seed+Prime5;
+    h += m_TotalLength;
+
+    const unsigned char* p = m_Buffer;
+    size_t size = m_BufferSize;
+    for (; size>=8; p+=8, size-=8)
+    {
+      h ^= Round(0, Read64(p));
+      h = RotateLeft(h, 27)*Prime1+Prime4;
+    }
+    if (size>=4)
+    {
+      h ^= uint64_t(Read32(p))*Prime1;
+      h = RotateLeft(h, 23)*Prime2+Prime3;
+      p += 4;
+      size -= 4;
+    }
+    for (; size>0; ++p, --size)
+    {
+      h ^= (*p)*Prime5;
+      h = RotateLeft(h, 11)*Prime1;
+    }
+
+    h ^= h>>33;
+    h *= Prime2;
+    h ^= h>>29;
+    h *= Prime3;
+    h ^= h>>32;
+    return h;
+  }
+
+  std::string GetHexDigest() const
+  {
+    std::ostringstream stream;
+    stream << std::hex << std::setw(16) << std::setfill('0') << GetDigest();
+    return stream.str();
+  }
+
+private:
+  static const uint64_t Prime1 = 0x9E3779B185EBCA87ULL;
+  static const uint64_t Prime2 = 0xC2B2AE3D27D4EB4FULL;
+  static const uint64_t Prime3 = 0x165667B19E3779F9ULL;
+  static const uint64_t Prime4 = 0x85EBCA77C2B2AE63ULL;
+  static const uint64_t Prime5 = 0x27D4EB2F165667C5ULL;
+
+  static uint64_t RotateLeft(uint64_t value, int bits)
+  {
+    return (value<<bits) | (value>>(64-bits));
+  }
+  static uint64_t Round(uint64_t accumulator, uint64_t input)
+  {
+    accumulator += input*Prime2;
+    return RotateLeft(accumulator, 31)*Prime1;
+  }
+  // little endian reads
+  static uint64_t Read64(const unsigned char* p)
+  {
+    uint64_t value = 0;
+    for (int i=7; i>=0; --i)
+      value = (value<<8) | p[i];
+    return value;
+  }
+  static uint32_t Read32(const unsigned char* p)
+  {
+    return uint32_t(p[0]) | uint32_t(p[1])<<8 | uint32_t(p[2])<<16 | uint32_t(p[3])<<24;
+  }
+  void ProcessStripe(const unsigned char* p)
+  {
+    m_State[0] = Round(m_State[0], Read64(p));
+    m_State[1] = Round(m_State[1], Read64(p+8));
+    m_State[2] = Round(m_State[2], Read64(p+16));
+    m_State[3] = Round(m_State[3], Read64(p+24));
+  }
+
+  uint64_t m_State[4];
+  uint64_t m_Seed;
+  uint64_t m_TotalLength;
+  unsigned char m_Buffer[32];
+  size_t m_BufferSize;
+};
+
+// returns whether filename is a header with detached data (.mhd or .nhdr)
+inline bool IsDetachedHeader(const std::string& filename)
+{
+  std::string extension = filename.substr(std::min(filename.size(), filename.rfind('.')));
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+    [](unsigned char c) { return char(std::tolower(c)); });
+  return extension==".mhd" || extension==".nhdr";
+}
+
+// find data file referenced by a .mhd or .nhdr header; dataFilename is left
+// empty if the data is stored in the header's file; returns false if the
+// header cannot be read or references a list or pattern of data files
+inline bool GetDetachedDataFile(const std::string& filename, std::string& dataFilename)
+{
+  dataFilename.clear();
+  std::ifstream infile( filename.c_str() );
+  if (!infile.good())
+    return false;
+  std::string line;
+  while (std::getline(infile, line) && !line.empty() && line!="\r")
+  {
+    // .mhd: "ElementDataFile = name", .nhdr: "data file: name"
+    size_t separator = std::string::npos;
+    if (line.compare(0, 15, "ElementDataFile")==0)
+      separator = line.find('=');
+    else if (line.compare(0, 10, "data file:")==0 || line.compare(0, 9, "datafile:")==0)
+      separator = line.find(':');
+    if (separator==std::string::npos)
+      continue;
+    const size_t first = line.find_first_not_of(" \t", separator+1);
+    const size_t last = line.find_last_not_of(" \t\r");
+    if (first==std::string::npos)
+      return false;
+    const std::string name = line.substr(first, last-first+1);
+    if (name=="LOCAL")
+      return true;
+    if (name.compare(0, 4, "LIST")==0 || name.find('%')!=std::string::npos ||
+      name.find(' ')!=std::string::npos)
+      return false;
+    const size_t directoryEnd = filename.find_last_of("/\\");
+    if (name[0]=='/' || directoryEnd==std::string::npos)
+      dataFilename = name;
+    else
+      dataFilename = filename.substr(0, directoryEnd+1)+name;
+    return true;
+  }
+  return true;
+}
+
+// cache of a tool's outputs keyed by hash of tool, inputs, and parameters
+class StageCache
+{
+public:
+  explicit StageCache(const std::string& toolName,
+    const std::string& buildId=LAPDMOUSE_BUILD_ID) :
+    m_ToolName(toolName)
+  {
+    const char* directory = getenv("LAPDMOUSE_CACHE_DIR");
+    m_Directory = directory && !buildId.empty() ? directory : "";
+    m_Hasher.Update(toolName);
+    m_Hasher.Update(buildId);
+  }
+
+  // caching is enabled if LAPDMOUSE_CACHE_DIR is set and the build is known
+  bool IsEnabled() const { return !m_Directory.empty(); }
+
+  // add content of an input file and of its detached data file to the key; a
+  // missing file yields a cache miss
+  void AddInputFile(const std::string& filename)
+  {
+    if (!IsEnabled())
+      return;
+    std::string dataFilename;
+    if (!m_Hasher.UpdateFile(filename) || (IsDetachedHeader(filename) &&
+      (!GetDetachedDataFile(filename, dataFilename) ||
+      (!dataFilename.empty() && !m_Hasher.UpdateFile(dataFilename)))))
+      m_Directory.clear(); // unable to verify input; disable cache
+  }
+
+  // add content of an input file if it exists, e.g. a label table
+  void AddOptionalInputFile(const std::string& filename)
+  {
+    if (!IsEnabled())
+      return;
+    const bool exists = std::ifstream( filename.c_str() ).good();
+    m_Hasher.Update(exists ? "present" : "missing");
+    if (exists)
+      AddInputFile(filename);
+  }
+
+  // add a parameter affecting the outputs to the key
+  template <typename T>
+  void AddParameter(const std::string& name, const T& value)
+  {
+    std::ostringstream stream;
+    stream << name << "=" << value;
+    m_Hasher.Update(stream.str());
+  }
+
+  // copy stored output to filename; returns true if output was cached;
+  // outputs with detached data are never cached
+  bool Restore(const std::string& outputName, const std::string& filename) const
+  {
+    return IsEnabled() && !IsDetachedHeader(filename) &&
+      CopyFile(GetCacheFilename(outputName), filename);
+  }
+
+  // store output written to filename in cache
+  void Store(const std::string& outputName, const std::string& filename) const
+  {
+    if (!IsEnabled() || IsDetachedHeader(filename))
+      return;
+    // copy to temporary file first, so that concurrent runs never read
+    // partially written outputs
+    const std::string cacheFilename = GetCacheFilename(outputName);
+    std::ostringstream temporaryFilename;
+    temporaryFilename << cacheFilename << ".tmp";
+#if !defined(_WIN32)
+    temporaryFilename << getpid();
+#endif
+    if (CopyFile(filename, temporaryFilename.str()))
+      std::rename(temporaryFilename.str().c_str(), cacheFilename.c_str());
+  }
+
+  // stored output as text, e.g. for outputs printed to the command line
+  bool Restore(const std::string& outputName, std::ostream& stream) const
+  {
+    if (!IsEnabled())
+      return false;
+    std::ifstream infile( GetCacheFilename(outputName).c_str(), std::ios::binary );
+    if (!infile.good())
+      return false;
+    stream << infile.rdbuf();
+    return true;
+  }
+
+  void StoreText(const std::string& outputName, const std::string& text) const
+  {
+    if (!IsEnabled())
+      return;
+    const std::string cacheFilename = GetCacheFilename(outputName);
+    std::ostringstream temporaryFilename;
+    temporaryFilename << cacheFilename << ".tmp";
+#if !defined(_WIN32)
+    temporaryFilename << getpid();
+#endif
+    {
+      std::ofstream outfile( temporaryFilename.str().c_str(), std::ios::binary );
+      outfile << text;
+      if (!outfile.good())
+        return;
+    }
+    std::rename(temporaryFilename.str().c_str(), cacheFilename.c_str());
+  }
+
+private:
+  std::string GetCacheFilename(const std::string& outputName) const
+  {
+    return m_Directory+"/"+m_ToolName+"-"+m_Hasher.GetHexDigest()+"-"+outputName;
+  }
+
+  static bool CopyFile(const std::string& source, const std::string& destination)
+  {
+    std::ifstream infile( source.c_str(), std::ios::binary );
+    if (!infile.good())
+      return false;
+    std::ofstream outfile( destination.c_str(), std::ios::binary );
+    outfile << infile.rdbuf();
+    return outfile.good();
+  }
+
+  std::string m_ToolName;
+  std::string m_Directory;
+  Hasher m_Hasher;
+};
+
+} // namespace lapdMouse
+
+#endif
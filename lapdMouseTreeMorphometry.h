@@ -0,0 +1,251 @@
+/*
+Helper to compute morphometric measurements for all airway segments of a
+flattened airway tree (see lapdMouseTreeSegments.h).
+
+Geometric measurements (length, arc length, radius statistics, tortuosity,
+center, direction) only depend on a segment's own centerline points and are
+computed in parallel over segments. The loops over the contiguous x/y/z/radius
+arrays are written as SIMD kernels: each keeps MorphometryLanes independent
+float accumulators updated without branches, which compilers map onto vector
+registers (sqrt requires -fno-math-errno, set by CMakeLists.txt), and combines
+them at the end. Topological measurements (branching angle, generation, Strahler order,
+path length from the trachea) are then derived in a single top-down and a
+single bottom-up pass over the segments in breadth-first order. The total
+effort is linear in the number of centerline points.
+
+The tree should be flattened with includeParentPoint set, so that segments
+start at their parent's connection point.
+*/
+
+#ifndef lapdMouseTreeMorphometry_h
+#define lapdMouseTreeMorphometry_h
+
+// ITK includes
+#include <itkMath.h>
+#include <itkMultiThreaderBase.h>
+#include "lapdMouseTreeSegments.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace lapdMouse
+{
+
+// morphometric measurements of one airway segment
+struct SegmentMorphometry
+{
+  double length;         // distance between first and last centerline point
+  double arcLength;      // length along centerline
+  double meanRadius;
+  double minRadius;
+  double maxRadius;
+  double tortuosity;     // arcLength/length
+  double center[3];      // midpoint between first and last centerline point
+  double direction[3];   // normalized vector from first to last centerline point
+  double branchingAngle; // angle to parent's direction in degrees
+  unsigned int generation;    // 0 for the trachea
+  unsigned int strahlerOrder; // 1 for terminal segments
+  double pathLength;     // arc length from the trachea's start to segment end
+};
+
+// order segments such that parents precede their children
+inline std::vector<size_t> GetBreadthFirstOrder(const TreeSegments& segments)
+{
+  const size_t numberOfSegments = segments.GetNumberOfSegments();
+  std::vector<size_t> order;
+  order.reserve(numberOfSegments);
+  for (size_t s=0; s<numberOfSegments; ++s)
+    if (segments.parents[s]<0)
+      order.push_back(s);
+  for (size_t i=0; i<order.size(); ++i)
+    for (size_t c=segments.childOffsets[order[i]]; c<segments.childOffsets[order[i]+1]; ++c)
+      order.push_back(segments.children[c]);
+  return order;
+}
+
+// number of independent accumulators of the kernels below, e.g. two SSE or
+// one AVX register of floats
+const size_t MorphometryLanes = 8;
+
+// keeps GCC from completely unrolling loops over lanes at -O3, after which
+// the conditional min/max updates are no longer vectorized
+#if defined(__GNUC__) && !defined(__clang__)
+#define LAPDMOUSE_LANE_LOOP _Pragma("GCC unroll 1")
+#else
+#define LAPDMOUSE_LANE_LOOP
+#endif
+
+// sum of distances between consecutive points
+inline double ComputeArcLength(const float* x, const float* y, const float* z,
+  size_t count)
+{
+  float lanes[MorphometryLanes] = {};
+  size_t i = 1;
+  for (; i+MorphometryLanes<=count; i+=MorphometryLanes)
+    LAPDMOUSE_LANE_LOOP
+    for (size_t l=0; l<MorphometryLanes; ++l)
+    {
+      const float dx = x[i+l]-x[i+l-1];
+      const float dy = y[i+l]-y[i+l-1];
+      const float dz = z[i+l]-z[i+l-1];
+      lanes[l] += std::sqrt(dx*dx+dy*dy+dz*dz);
+    }
+  double arcLength = 0;
+  for (size_t l=0; l<MorphometryLanes; ++l)
+    arcLength += lanes[l];
+  for (; i<count; ++i)
+  {
+    const float dx = x[i]-x[i-1];
+    const float dy = y[i]-y[i-1];
+    const float dz = z[i]-z[i-1];
+    arcLength += std::sqrt(dx*dx+dy*dy+dz*dz);
+  }
+  return arcLength;
+}
+
+// sum, minimum, and maximum of count>0 radii
+inline void ComputeRadiusStatistics(const float* radius, size_t count,
+  double& sum, float& minimum, float& maximum)
+{
+  float sumLanes[MorphometryLanes] = {};
+  float minLanes[MorphometryLanes];
+  float maxLanes[MorphometryLanes];
+  std::fill(minLanes, minLanes+MorphometryLanes, radius[0]);
+  std::fill(maxLanes, maxLanes+MorphometryLanes, radius[0]);
+  size_t i = 0;
+  for (; i+MorphometryLanes<=count; i+=MorphometryLanes)
+    LAPDMOUSE_LANE_LOOP
+    for (size_t l=0; l<MorphometryLanes; ++l)
+    {
+      const float r = radius[i+l];
+      sumLanes[l] += r;
+      minLanes[l] = r<minLanes[l] ? r : minLanes[l];
+      maxLanes[l] = r>maxLanes[l] ? r : maxLanes[l];
+    }
+  sum = 0;
+  minimum = minLanes[0];
+  maximum = maxLanes[0];
+  for (size_t l=0; l<MorphometryLanes; ++l)
+  {
+    sum += sumLanes[l];
+    minimum = std::min(minimum, minLanes[l]);
+    maximum = std::max(maximum, maxLanes[l]);
+  }
+  for (; i<count; ++i)
+  {
+    sum += radius[i];
+    minimum = std::min(minimum, radius[i]);
+    maximum = std::max(maximum, radius[i]);
+  }
+}
+
+// compute morphometric measurements of all segments
+inline std::vector<SegmentMorphometry> ComputeMorphometry(const TreeSegments& segments)
+{
+  const size_t numberOfSegments = segments.GetNumberOfSegments();
+  std::vector<SegmentMorphometry> morphometry(numberOfSegments);
+
+  // geometric measurements of each segment
+  itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+  threader->ParallelizeArray( 0, numberOfSegments,
+    [&](itk::SizeValueType s)
+    {
+      SegmentMorphometry& m = morphometry[s];
+      const size_t first = segments.pointOffsets[s];
+      const size_t count = segments.GetNumberOfPoints(s);
+      const float* x = segments.x.data()+first;
+      const float* y = segments.y.data()+first;
+      const float* z = segments.z.data()+first;
+      const float* radius = segments.radius.data()+first;
+      const double nan = std::numeric_limits<double>::quiet_NaN();
+      if (count==0)
+      {
+        m.length = m.arcLength = m.tortuosity = 0;
+        m.meanRadius = m.minRadius = m.maxRadius = nan;
+        std::fill(m.center, m.center+3, nan);
+        std::fill(m.direction, m.direction+3, nan);
+        return;
+      }
+
+      const double arcLength = ComputeArcLength(x, y, z, count);
+      double radiusSum;
+      float minRadius, maxRadius;
+      ComputeRadiusStatistics(radius, count, radiusSum, minRadius, maxRadius);
+
+      const double start[3] = { x[0], y[0], z[0] };
+      const double end[3] = { x[count-1], y[count-1], z[count-1] };
+      double length = 0;
+      for (unsigned int d=0; d<3; ++d)
+      {
+        m.center[d] = 0.5*(start[d]+end[d]);
+        m.direction[d] = end[d]-start[d];
+        length += m.direction[d]*m.direction[d];
+      }
+      length = std::sqrt(length);
+      for (unsigned int d=0; d<3; ++d)
+        m.direction[d] /= length;
+
+      m.length = length;
+      m.arcLength = arcLength;
+      m.meanRadius = radiusSum/count;
+      m.minRadius = minRadius;
+      m.maxRadius = maxRadius;
+      m.tortuosity = length>0 ? arcLength/length : nan;
+    }, nullptr );
+
+  // top-down pass: branching angle, generation and path length
+  const std::vector<size_t> order = GetBreadthFirstOrder(segments);
+  for (size_t i=0; i<order.size(); ++i)
+  {
+    const size_t s = order[i];
+    SegmentMorphometry& m = morphometry[s];
+    const int parent = segments.parents[s];
+    if (parent<0)
+    {
+      m.branchingAngle = std::numeric_limits<double>::quiet_NaN();
+      m.generation = 0;
+      m.pathLength = m.arcLength;
+      continue;
+    }
+    const SegmentMorphometry& p = morphometry[parent];
+    double cosine = 0;
+    for (unsigned int d=0; d<3; ++d)
+      cosine += m.direction[d]*p.direction[d];
+    cosine = std::max(-1.0, std::min(1.0, cosine));
+    m.branchingAngle = std::acos(cosine)*180.0/itk::Math::pi;
+    m.generation = p.generation+1;
+    m.pathLength = p.pathLength+m.arcLength;
+  }
+
+  // bottom-up pass: Strahler order; a parent's order is its children's
+  // maximum order, increased by one if at least two children have it
+  std::vector<unsigned int> maxChildOrder(numberOfSegments, 0);
+  std::vector<unsigned int> maxChildOrderCount(numberOfSegments, 0);
+  for (size_t i=order.size(); i-->0; )
+  {
+    const size_t s = order[i];
+    SegmentMorphometry& m = morphometry[s];
+    if (maxChildOrder[s]==0)
+      m.strahlerOrder = 1;
+    else
+      m.strahlerOrder = maxChildOrder[s]+(maxChildOrderCount[s]>1 ? 1 : 0);
+    const int parent = segments.parents[s];
+    if (parent<0)
+      continue;
+    if (m.strahlerOrder>maxChildOrder[parent])
+    {
+      maxChildOrder[parent] = m.strahlerOrder;
+      maxChildOrderCount[parent] = 1;
+    }
+    else if (m.strahlerOrder==maxChildOrder[parent])
+      ++maxChildOrderCount[parent];
+  }
+
+  return morphometry;
+}
+
+} // namespace lapdMouse
+
+#endif
@@ -0,0 +1,157 @@
+/*
+Helper to flatten the airway tree structure of AirwayTree.meta into
+contiguous arrays.
+
+Tools processing the centerline points of all airway segments in bulk (e.g. in
+parallel over segments) can iterate over plain x/y/z/radius arrays instead of
+a list of TubeSpatialObjects. The centerline points of segment i are stored in
+the range [pointOffsets[i], pointOffsets[i+1]) of these arrays. Segments are
+sorted by their ID and reference their parent by index; the indices of the
+children of segment i are stored in the range [childOffsets[i],
+childOffsets[i+1]) of the children array.
+*/
+
+#ifndef lapdMouseTreeSegments_h
+#define lapdMouseTreeSegments_h
+
+// ITK includes
+#include <itkSpatialObject.h>
+#include <itkTubeSpatialObject.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace lapdMouse
+{
+
+// airway segments and their centerline points stored as contiguous arrays
+struct TreeSegments
+{
+  std::vector<unsigned int> ids;
+  std::vector<int> parents; // index of parent segment; -1 for the trachea
+  std::vector<int> parentIds; // ID of parent spatial object
+  std::vector<int> parentPoints; // parent's centerline point connected to; -1 if unknown
+  std::vector<std::string> names;
+  std::vector<size_t> childOffsets; // size is number of segments + 1
+  std::vector<size_t> children;
+  std::vector<size_t> pointOffsets; // size is number of segments + 1
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<float> radius;
+
+  size_t GetNumberOfSegments() const { return ids.size(); }
+  size_t GetNumberOfPoints(size_t segment) const
+  {
+    return pointOffsets[segment+1]-pointOffsets[segment];
+  }
+};
+
+// fill child lists from parent indices; children are sorted by index
+inline void ComputeChildren(TreeSegments& segments)
+{
+  const size_t numberOfSegments = segments.GetNumberOfSegments();
+  segments.childOffsets.assign(numberOfSegments+1, 0);
+  for (size_t s=0; s<numberOfSegments; ++s)
+    if (segments.parents[s]>=0)
+      ++segments.childOffsets[segments.parents[s]+1];
+  for (size_t s=0; s<numberOfSegments; ++s)
+    segments.childOffsets[s+1] += segments.childOffsets[s];
+  segments.children.resize(segments.childOffsets[numberOfSegments]);
+  std::vector<size_t> childCount(numberOfSegments, 0);
+  for (size_t s=0; s<numberOfSegments; ++s)
+    if (segments.parents[s]>=0)
+    {
+      const size_t parent = segments.parents[s];
+      segments.children[segments.childOffsets[parent]+childCount[parent]++] = s;
+    }
+}
+
+// flatten airway tree; if includeParentPoint is set, each segment's points
+// start with the parent's connection point, so that segments with only one
+// centerline point still have an extent
+inline TreeSegments FlattenTree(itk::SpatialObject<3>* tree, bool includeParentPoint)
+{
+  using SpatialObjectType = itk::SpatialObject<3>;
+  using TubeType = itk::TubeSpatialObject<3>;
+
+  // obtain list of tree segments and store in map segmentID -> SpatialObject
+  using SegmentMapType = std::map<unsigned int, TubeType*>;
+  SegmentMapType segmentMap;
+  SpatialObjectType::ChildrenListType* segments = tree->GetChildren(
+    SpatialObjectType::MaximumDepth, (char*)"VesselTubeSpatialObject");
+  for (SpatialObjectType::ChildrenListType::iterator segmentIt = segments->begin();
+    segmentIt!=segments->end(); ++segmentIt)
+  {
+    TubeType* segment = dynamic_cast<TubeType*>(segmentIt->GetPointer());
+    segmentMap[segment->GetId()] = segment;
+  }
+  delete segments;
+
+  TreeSegments result;
+  std::map<unsigned int, int> segmentIndices;
+  for (SegmentMapType::const_iterator it=segmentMap.begin();
+    it!=segmentMap.end(); ++it)
+  {
+    segmentIndices[it->first] = static_cast<int>(result.ids.size());
+    result.ids.push_back(it->first);
+  }
+
+  size_t numberOfPoints = 0;
+  for (SegmentMapType::const_iterator it=segmentMap.begin();
+    it!=segmentMap.end(); ++it)
+    numberOfPoints += it->second->GetNumberOfPoints()+(includeParentPoint ? 1 : 0);
+  result.x.reserve(numberOfPoints);
+  result.y.reserve(numberOfPoints);
+  result.z.reserve(numberOfPoints);
+  result.radius.reserve(numberOfPoints);
+  result.pointOffsets.push_back(0);
+
+  for (SegmentMapType::const_iterator it=segmentMap.begin();
+    it!=segmentMap.end(); ++it)
+  {
+    TubeType* segment = it->second;
+    result.names.push_back(segment->GetProperty().GetName());
+
+    // parent is an airway segment unless segment is the trachea
+    TubeType* parent = nullptr;
+    if (segment->GetParent()->GetNameOfClass()==segment->GetNameOfClass())
+      parent = dynamic_cast<TubeType*>(segment->GetParent());
+    std::map<unsigned int, int>::const_iterator parentIt = parent ?
+      segmentIndices.find(parent->GetId()) : segmentIndices.end();
+    result.parents.push_back(parentIt!=segmentIndices.end() ? parentIt->second : -1);
+    result.parentIds.push_back(segment->GetParent()->GetId());
+    result.parentPoints.push_back(segment->GetParentPoint());
+
+    if (includeParentPoint && parent && parent->GetNumberOfPoints()>0)
+    {
+      int parentPoint = segment->GetParentPoint();
+      if (parentPoint<0 || parentPoint>=int(parent->GetNumberOfPoints()))
+        parentPoint = int(parent->GetNumberOfPoints())-1;
+      const TubeType::TubePointType& point = parent->GetPoints()[parentPoint];
+      result.x.push_back(point.GetPositionInObjectSpace()[0]);
+      result.y.push_back(point.GetPositionInObjectSpace()[1]);
+      result.z.push_back(point.GetPositionInObjectSpace()[2]);
+      result.radius.push_back(point.GetRadiusInObjectSpace());
+    }
+
+    const TubeType::TubePointListType& points = segment->GetPoints();
+    for (TubeType::TubePointListType::const_iterator pointIt=points.begin();
+      pointIt!=points.end(); ++pointIt)
+    {
+      result.x.push_back(pointIt->GetPositionInObjectSpace()[0]);
+      result.y.push_back(pointIt->GetPositionInObjectSpace()[1]);
+      result.z.push_back(pointIt->GetPositionInObjectSpace()[2]);
+      result.radius.push_back(pointIt->GetRadiusInObjectSpace());
+    }
+    result.pointOffsets.push_back(result.x.size());
+  }
+  ComputeChildren(result);
+
+  return result;
+}
+
+} // namespace lapdMouse
+
+#endif
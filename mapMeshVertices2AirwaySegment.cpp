@@ -0,0 +1,141 @@
+/*
+Tool to assign every vertex of a surface mesh to its closest airway segment in
+AirwayTree.meta.
+
+```bash
+./mapMeshVertices2AirwaySegment m01_AirwaySurface.vtk m01_AirwayTree.meta m01_AirwaySurfaceSegments.vtk m01_AirwaySurfaceSegments.csv
+```
+
+In contrast to AirwaySegments.vtk, meshes derived otherwise (e.g. remeshed or
+smoothed surfaces) do not carry segment IDs. This tool computes for every mesh
+vertex the airway segment whose tube surface is closest, using the distance to
+the centerline minus the radius interpolated along the centerline (negative
+inside the airway). The segment IDs are stored as point data of the output
+mesh, so that it can be used in place of AirwaySegments.vtk, e.g. with
+labelTreePathAndChildren. Optionally, vertex IDs, segment IDs, and distances
+are written to a Comma Separated Value (CSV) table. The segments are indexed
+in a bounding volume hierarchy (see lapdMouseCapsuleIndex.h) and the vertices
+are processed in parallel.
+*/
+
+#include <itkMesh.h>
+#include <itkMeshFileWriter.h>
+#include <itkMultiThreaderBase.h>
+#include <itkSpatialObject.h>
+#include <algorithm>
+#include <fstream>
+#include "lapdMouseAsyncReader.h"
+#include "lapdMouseCapsuleIndex.h"
+#include "lapdMouseTreeSegments.h"
+
+int main(int argc, char**argv)
+{
+  if (argc!=4 && argc!=5)
+  {
+    std::cerr << "Usage: " << argv[0] << " mesh airwayTree labeledMesh [vertexTable]" << std::endl;
+    return -1;
+  }
+
+  std::string meshFilename = argv[1];
+  std::string treeFilename = argv[2];
+  std::string outputFilename = argv[3];
+  std::string tableFilename = argc==5 ? argv[4] : "";
+
+  // start reading mesh and airwayTree concurrently; the tree is flattened while
+  // the mesh is still loading
+  using MeshType = itk::Mesh< float, 3 >;
+  std::future<MeshType::Pointer> meshFuture =
+    lapdMouse::ReadMeshAsync<MeshType>( meshFilename );
+  using SpatialObjectType = itk::SpatialObject<3>;
+  std::future<SpatialObjectType::Pointer> treeFuture =
+    lapdMouse::ReadTreeAsync( treeFilename );
+
+  MeshType::Pointer mesh;
+  lapdMouse::TreeSegments segments;
+  try
+  {
+    SpatialObjectType::Pointer tree = treeFuture.get();
+    segments = lapdMouse::FlattenTree( tree.GetPointer(), true );
+    mesh = meshFuture.get();
+  }
+  catch( itk::ExceptionObject & e )
+  {
+    std::cout << e << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const lapdMouse::CapsuleIndex index( segments );
+  if (index.GetNumberOfCapsules()==0)
+  {
+    std::cerr << "Error: tree does not contain centerline points" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // copy vertices into a contiguous array
+  const size_t numberOfVertices = mesh->GetNumberOfPoints();
+  std::vector<float> vertices(3*numberOfVertices);
+  MeshType::PointsContainer::Pointer points = mesh->GetPoints();
+  size_t v = 0;
+  for (MeshType::PointsContainer::ConstIterator pointIt=points->Begin();
+    pointIt!=points->End(); ++pointIt, ++v)
+    for (unsigned int d=0; d<3; ++d)
+      vertices[3*v+d] = pointIt.Value()[d];
+
+  // find closest segment of each vertex; vertices are processed in blocks,
+  // so that consecutive vertices, which tend to be close, share a thread
+  std::vector<unsigned int> vertexSegments(numberOfVertices);
+  std::vector<float> vertexDistances(numberOfVertices);
+  const size_t blockSize = 1024;
+  const size_t numberOfBlocks = (numberOfVertices+blockSize-1)/blockSize;
+  itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+  threader->ParallelizeArray( 0, numberOfBlocks,
+    [&](itk::SizeValueType block)
+    {
+      const size_t end = std::min(numberOfVertices, (block+1)*blockSize);
+      for (size_t i=block*blockSize; i<end; ++i)
+      {
+        const int segment = index.FindNearestSegment( &vertices[3*i], vertexDistances[i] );
+        vertexSegments[i] = segments.ids[segment];
+      }
+    }, nullptr );
+
+  // replace point data with segment IDs and write labeled mesh
+  MeshType::PointDataContainer::Pointer pointData = MeshType::PointDataContainer::New();
+  pointData->Reserve( numberOfVertices );
+  v = 0;
+  for (MeshType::PointsContainer::ConstIterator pointIt=points->Begin();
+    pointIt!=points->End(); ++pointIt, ++v)
+    pointData->SetElement( pointIt.Index(), vertexSegments[v] );
+  mesh->SetPointData( pointData );
+
+  try
+  {
+    typedef itk::MeshFileWriter<MeshType> WriterType;
+    WriterType::Pointer writer = WriterType::New();
+    writer->SetInput( mesh );
+    writer->SetFileName( outputFilename.c_str() );
+    writer->SetUseCompression( true );
+    writer->Update();
+  }
+  catch( itk::ExceptionObject & e )
+  {
+    std::cout << e << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // write vertex table
+  if (!tableFilename.empty())
+  {
+    std::ofstream outfile;
+    outfile.open( tableFilename.c_str() );
+    outfile << "vertexId,segmentId,distance" << std::endl;
+    v = 0;
+    for (MeshType::PointsContainer::ConstIterator pointIt=points->Begin();
+      pointIt!=points->End(); ++pointIt, ++v)
+      outfile << pointIt.Index() << "," << vertexSegments[v] << ","
+        << vertexDistances[v] << std::endl;
+    outfile.close();
+  }
+
+  return EXIT_SUCCESS;
+}
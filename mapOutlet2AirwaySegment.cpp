@@ -13,10 +13,9 @@ Value (CSV) format.
 */
 
 #include <itkMesh.h>
-#include <itkMeshFileReader.h>
 #include <itkSpatialObject.h>
-#include <itkSpatialObjectReader.h>
 #include <set>
+#include "lapdMouseAsyncReader.h"
 
 int main(int argc, char**argv)
 {
@@ -26,23 +25,19 @@ int main(int argc, char**argv)
     return -1;
   }
 
-  // read airwayOutletsMesh
+  // start reading airwayOutletsMesh and airwayTree concurrently; outlet
+  // centers are computed while the tree is still loading
   using MeshType = itk::Mesh< float, 3 >;
   std::string outletMeshFilename = argv[1];
-  using MeshReaderType = itk::MeshFileReader<MeshType>;
-  MeshReaderType::Pointer meshReader = MeshReaderType::New();
-  meshReader->SetFileName( outletMeshFilename.c_str() );
-  meshReader->Update();
-  MeshType::Pointer mesh = meshReader->GetOutput();
-
-  // read airwayTree
+  std::future<MeshType::Pointer> meshFuture =
+    lapdMouse::ReadMeshAsync<MeshType>( outletMeshFilename );
   using SpatialObjectType = itk::SpatialObject<3>;
   std::string treeFilename = argv[2];
-  using TreeReaderType = itk::SpatialObjectReader<3,float>;
-  TreeReaderType::Pointer treeReader = TreeReaderType::New();
-  treeReader->SetFileName( treeFilename );
-  treeReader->Update();
-  SpatialObjectType::Pointer tree( treeReader->GetGroup() );
+  std::future<SpatialObjectType::Pointer> treeFuture =
+    lapdMouse::ReadTreeAsync( treeFilename );
+
+  // wait for airwayOutletsMesh
+  MeshType::Pointer mesh = meshFuture.get();
 
   // iterate over all mesh points and find for each outlet region the set of
   // accociated points
@@ -79,6 +74,9 @@ int main(int argc, char**argv)
     outletCenters[it->first] = (PointType)center;
   }
 
+  // wait for airwayTree
+  SpatialObjectType::Pointer tree = treeFuture.get();
+
   // for each outlet center find the closest airway segment
   using OutletSegmentMap = std::map<unsigned int, unsigned int>;
   OutletSegmentMap outletSegmentMap;
@@ -13,12 +13,16 @@ len(segments)
 segments[0]['ID']
 segments[0]['Name']
 segments[0]['Children']
+segments[0]['ParentPoint']
 ```
 */
 
 #include <itkSpatialObject.h>
 #include <itkSpatialObjectReader.h>
 #include <fstream>
+#include <iomanip>
+#include <limits>
+#include "lapdMouseStageCache.h"
 
 int main(int argc, char**argv)
 {
@@ -31,6 +35,12 @@ int main(int argc, char**argv)
   std::string inputFilename = argv[1];
   std::string outputFilename = argv[2];
 
+  // reuse output of a previous run with identical input
+  lapdMouse::StageCache cache( "metaTree2JsonConverter" );
+  cache.AddInputFile( inputFilename );
+  if (cache.Restore( "json", outputFilename ))
+    return 0;
+
   // read spatial objects
   using SpatialObjectType = itk::SpatialObject<3>;
   using ReaderType = itk::SpatialObjectReader<3,float>;
@@ -42,6 +52,8 @@ int main(int argc, char**argv)
   // open output file for writing
   std::ofstream outfile;
   outfile.open( outputFilename.c_str() );
+  // write enough digits for coordinates and radii to be read back exactly
+  outfile << std::setprecision( std::numeric_limits<float>::max_digits10 );
   outfile << "[" << std::endl;
 
   // find all tree segments which utilize type VesselTubeSpatialObject
@@ -61,6 +73,12 @@ int main(int argc, char**argv)
     // output ID of segment
     outfile << "    \"ID\": " << segment->GetId() << "," << std::endl;
 
+    // output ID of parent (the enclosing group for the trachea) and index of
+    // the parent's centerline point the segment is connected to
+    outfile << "    \"ParentID\": " << (segment->GetParent() ? segment->GetParent()->GetId() : -1)
+      << "," << std::endl;
+    outfile << "    \"ParentPoint\": " << segment->GetParentPoint() << "," << std::endl;
+
     // output name of segment if specified
     if (segment->GetProperty().GetName()!="")
       outfile << "    \"Name\": \"" << segment->GetProperty().GetName() << "\"," << std::endl;
@@ -110,6 +128,7 @@ int main(int argc, char**argv)
 
   outfile << "]" << std::endl;
   outfile.close();
+  cache.Store( "json", outputFilename );
 
   return 0;
 }
@@ -1,84 +1,47 @@
 /*
 Example partitioning the lung's Lobes.nrrd into disjoint compartments based the
 distance to AirwayTree.meta terminal segments. The obtained
-compartmentalization is output to terminalCompartments.
+compartmentalization is output to terminalCompartments. Since the labels are
+terminal segment IDs, they are stored as dense ordinals together with a table
+mapping ordinals to segment IDs (e.g. m01_TerminalCompartmentsLabels.csv).
 
 ```bash
 ./partitionLobesIntoTerminalCompartments m01_Lobes.nrrd m01_AirwayTree.meta m01_TerminalCompartments.nrrd
 ```
+
+With the optional flag `--parallel`, the compartments of different lobes are
+grown concurrently, each lobe with a priority queue of its own. Ties between
+voxels equidistant to several seeds are then resolved in favor of the lower
+terminal segment ID, so that the result is reproducible independent of the
+number of threads; it may differ from the default mode in such voxels.
 */
 
 #include <itkImage.h>
-#include <itkImageFileReader.h>
-#include <itkImageFileWriter.h>
 #include <itkShrinkImageFilter.h>
 #include <itkSpatialObject.h>
-#include <itkSpatialObjectReader.h>
 #include <itkPriorityQueueContainer.h>
 #include <itkNeighborhoodIterator.h>
+#include <itkMultiThreaderBase.h>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include "lapdMouseAsyncReader.h"
+#include "lapdMouseCompactLabelmap.h"
+#include "lapdMouseStageCache.h"
 
-int main(int argc, char**argv)
-{
-  if (argc!=4)
-  {
-    std::cerr << "Usage: " << argv[0] << " lobes airwayTree terminalCompartments" << std::endl;
-    return -1;
-  }
+using LabelmapType = itk::Image< unsigned short, 3 >;
+using PointType = LabelmapType::PointType;
+using IndexType = LabelmapType::IndexType;
+using TerminalSeedMapType = std::map<unsigned int, PointType>;
 
-  // read lobe labelmap and shrink it for faster processing
-  using LabelmapType = itk::Image< unsigned short, 3 >;
-  using PointType = LabelmapType::PointType;
-  using IndexType = LabelmapType::IndexType;
-  std::string lobesFilename = argv[1];
-  using ReaderType = itk::ImageFileReader<LabelmapType>;
-  ReaderType::Pointer reader = ReaderType::New();
-  reader->SetFileName( lobesFilename.c_str() );
-  using ShrinkImageFilterType = itk::ShrinkImageFilter< LabelmapType, LabelmapType >;
-  ShrinkImageFilterType::Pointer shrinkFilter = ShrinkImageFilterType::New();
-  unsigned int shrinkfactor[3] = {8,8,8};
-  shrinkFilter->SetShrinkFactors( shrinkfactor );
-  shrinkFilter->SetInput( reader->GetOutput() );
-  shrinkFilter->Update();
-  LabelmapType::Pointer lobes = shrinkFilter->GetOutput();
-
-  // read airwayTree
-  using SpatialObjectType = itk::SpatialObject<3>;
-  std::string treeFilename = argv[2];
-  using TreeReaderType = itk::SpatialObjectReader<3,float>;
-  TreeReaderType::Pointer treeReader = TreeReaderType::New();
-  treeReader->SetFileName( treeFilename );
-  treeReader->Update();
-  SpatialObjectType::Pointer tree( treeReader->GetGroup() );
+// terminal segment IDs may exceed the range of the lobe labelmap's pixel type
+using CompartmentsType = itk::Image< unsigned int, 3 >;
 
-  // search terminal airway segments and use their end points as seeds points
-  // to partition the lobes into compartments
-  using TerminalSeedMapType = std::map<unsigned int, PointType>;
-  TerminalSeedMapType terminalSeedMap;
-  SpatialObjectType::ChildrenListType* segments = tree->GetChildren(
-    SpatialObjectType::MaximumDepth, (char*)"VesselTubeSpatialObject");
-  using TubeType = itk::TubeSpatialObject<3>;
-  for (SpatialObjectType::ChildrenListType::iterator segmentIt = segments->begin();
-    segmentIt!=segments->end(); ++segmentIt)
-  {
-    TubeType::Pointer segment( dynamic_cast<TubeType*>(segmentIt->GetPointer()) );
-    if (segment->GetNumberOfChildren()==0) // terminal segment
-    {
-      PointType segmentEndPoint =
-        segment->GetPoint(segment->GetNumberOfPoints()-1)->GetPositionInObjectSpace();
-      terminalSeedMap[segment->GetId()] = segmentEndPoint;
-    }
-  }
-  delete segments;
-
-  // initalize compartment image
-  LabelmapType::Pointer compartments = LabelmapType::New();
-  compartments->CopyInformation( lobes );
-  compartments->SetRegions( lobes->GetLargestPossibleRegion() );
-  compartments->Allocate();
-  compartments->FillBuffer(0);
-
-  // expand terminal compartment regions starting from seed points based on
-  // their distance to the seed point using a priority queue.
+// expand terminal compartment regions starting from seed points based on
+// their distance to the seed point using a single priority queue
+void GrowCompartments(const LabelmapType* lobes, CompartmentsType* compartments,
+  TerminalSeedMapType& terminalSeedMap)
+{
   using PQDataType = std::pair<unsigned int, LabelmapType::IndexType>;
   std::map<size_t, PQDataType> PQDataMap;
   size_t PQDataMapElementId = 0;
@@ -103,7 +66,7 @@ int main(int argc, char**argv)
     priorityQueue->Push( PQElementType(PQDataMapElementId, distance) );
   }
 
-  using NeighborhoodIteratorType = itk::NeighborhoodIterator< LabelmapType >;
+  using NeighborhoodIteratorType = itk::NeighborhoodIterator< CompartmentsType >;
   NeighborhoodIteratorType nIterator;
   NeighborhoodIteratorType::RadiusType radius;
   radius.Fill( 1 );
@@ -142,15 +105,217 @@ int main(int argc, char**argv)
       }
     }
   }
+}
+
+// candidate voxel of a compartment; candidates are ordered by distance, then
+// by seed and voxel offset, so that ties between equidistant seeds are always
+// resolved the same way; seeds are sorted by terminal segment ID
+struct CompartmentCandidate
+{
+  double distance;
+  unsigned int seed;
+  size_t offset;
+
+  bool operator>(const CompartmentCandidate& other) const
+  {
+    if (distance!=other.distance)
+      return distance>other.distance;
+    if (seed!=other.seed)
+      return seed>other.seed;
+    return offset>other.offset;
+  }
+};
+
+// expand terminal compartment regions like GrowCompartments, but grow the
+// compartments of each lobe concurrently; since compartments never cross lobe
+// boundaries, the lobes are independent and every worker owns the voxels of
+// its lobe label and a priority queue of its own; the result does not depend
+// on the number of threads
+void GrowCompartmentsPerLobe(const LabelmapType* lobes, CompartmentsType* compartments,
+  const TerminalSeedMapType& terminalSeedMap)
+{
+  const LabelmapType::RegionType region = lobes->GetLargestPossibleRegion();
+  const IndexType start = region.GetIndex();
+  const LabelmapType::SizeType size = region.GetSize();
+  const long dimensions[3] = { long(size[0]), long(size[1]), long(size[2]) };
+  const size_t strides[3] = { 1, size[0], size[0]*size[1] };
+  const LabelmapType::PixelType* lobeBuffer = lobes->GetBufferPointer();
+  CompartmentsType::PixelType* compartmentBuffer = compartments->GetBufferPointer();
+
+  // voxel center = origin + matrix*(start+i/j/k)
+  const LabelmapType::DirectionType& matrix = lobes->GetIndexToPhysicalPointMatrix();
+  const PointType& origin = lobes->GetOrigin();
+
+  // group seeds by the lobe label at their voxel, in order of terminal
+  // segment IDs
+  using SeedType = std::pair<unsigned int, PointType>;
+  std::map<LabelmapType::PixelType, std::vector<SeedType> > lobeSeeds;
+  for (TerminalSeedMapType::const_iterator it=terminalSeedMap.begin();
+    it!=terminalSeedMap.end(); ++it)
+  {
+    IndexType index;
+    if (!lobes->TransformPhysicalPointToIndex(it->second, index))
+    {
+      std::cerr << "Warning: end point of terminal segment " << it->first
+        << " is outside of lobes" << std::endl;
+      continue;
+    }
+    lobeSeeds[lobes->GetPixel(index)].push_back(*it);
+  }
+  std::vector<LabelmapType::PixelType> lobeLabels;
+  for (std::map<LabelmapType::PixelType, std::vector<SeedType> >::const_iterator
+    it=lobeSeeds.begin(); it!=lobeSeeds.end(); ++it)
+    lobeLabels.push_back(it->first);
 
-  // write terminal compartment labelmap
+  itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+  threader->ParallelizeArray( 0, lobeLabels.size(),
+    [&](itk::SizeValueType l)
+    {
+      const LabelmapType::PixelType lobe = lobeLabels[l];
+      const std::vector<SeedType>& seeds = lobeSeeds.find(lobe)->second;
+      std::priority_queue< CompartmentCandidate, std::vector<CompartmentCandidate>,
+        std::greater<CompartmentCandidate> > priorityQueue;
+
+      // physical distance of voxel i/j/k to seed
+      auto distance = [&](long i, long j, long k, const PointType& seed)
+      {
+        double distance2 = 0;
+        for (unsigned int d=0; d<3; ++d)
+        {
+          const double delta = origin[d]+matrix[d][0]*(start[0]+i)+
+            matrix[d][1]*(start[1]+j)+matrix[d][2]*(start[2]+k)-seed[d];
+          distance2 += delta*delta;
+        }
+        return std::sqrt(distance2);
+      };
+
+      // initialize priority queue with seed voxels
+      for (size_t s=0; s<seeds.size(); ++s)
+      {
+        IndexType index;
+        lobes->TransformPhysicalPointToIndex(seeds[s].second, index);
+        const long i = index[0]-start[0], j = index[1]-start[1], k = index[2]-start[2];
+        CompartmentCandidate candidate;
+        candidate.distance = distance(i, j, k, seeds[s].second);
+        candidate.seed = static_cast<unsigned int>(s);
+        candidate.offset = i*strides[0]+j*strides[1]+k*strides[2];
+        priorityQueue.push(candidate);
+      }
+
+      while (!priorityQueue.empty())
+      {
+        const CompartmentCandidate candidate = priorityQueue.top();
+        priorityQueue.pop();
+        if (compartmentBuffer[candidate.offset]!=0)
+          continue;
+        compartmentBuffer[candidate.offset] = seeds[candidate.seed].first;
+        const PointType& seed = seeds[candidate.seed].second;
+        const long i = long(candidate.offset%strides[1]);
+        const long j = long((candidate.offset/strides[1])%size[1]);
+        const long k = long(candidate.offset/strides[2]);
+        for (long nk=std::max(k-1, 0L); nk<=std::min(k+1, dimensions[2]-1); ++nk)
+          for (long nj=std::max(j-1, 0L); nj<=std::min(j+1, dimensions[1]-1); ++nj)
+            for (long ni=std::max(i-1, 0L); ni<=std::min(i+1, dimensions[0]-1); ++ni)
+            {
+              const size_t offset = ni+nj*strides[1]+nk*strides[2];
+              if (lobeBuffer[offset]!=lobe || compartmentBuffer[offset]!=0)
+                continue;
+              CompartmentCandidate neighbor;
+              neighbor.distance = distance(ni, nj, nk, seed);
+              neighbor.seed = candidate.seed;
+              neighbor.offset = offset;
+              priorityQueue.push(neighbor);
+            }
+      }
+    }, nullptr );
+}
+
+int main(int argc, char**argv)
+{
+  bool parallelFill = argc==5 && std::string(argv[4])=="--parallel";
+  if (argc!=4 && !parallelFill)
+  {
+    std::cerr << "Usage: " << argv[0] << " lobes airwayTree terminalCompartments [--parallel]" << std::endl;
+    return -1;
+  }
+
+  std::string lobesFilename = argv[1];
+  std::string treeFilename = argv[2];
   std::string outputFilename = argv[3];
-  typedef itk::ImageFileWriter<LabelmapType> WriterType;
-  WriterType::Pointer writer = WriterType::New();
-  writer->SetInput( compartments );
-  writer->SetFileName( outputFilename.c_str() );
-  writer->SetUseCompression( true );
-  writer->Update();
+  std::string labelTableFilename = lapdMouse::GetLabelTableFilename( outputFilename );
+  const unsigned int shrinkfactor[3] = {8,8,8};
+
+  // reuse outputs of a previous run with identical inputs and parameters
+  lapdMouse::StageCache cache( "partitionLobesIntoTerminalCompartments" );
+  cache.AddInputFile( lobesFilename );
+  cache.AddInputFile( treeFilename );
+  cache.AddParameter( "shrinkfactor", std::to_string(shrinkfactor[0])+","+
+    std::to_string(shrinkfactor[1])+","+std::to_string(shrinkfactor[2]) );
+  cache.AddParameter( "outputFormat", outputFilename.substr(
+    outputFilename.find_last_of('.')+1) );
+  cache.AddParameter( "parallel", parallelFill );
+  if (cache.Restore( "labelmap", outputFilename ) &&
+    cache.Restore( "labels", labelTableFilename ))
+    return EXIT_SUCCESS;
+
+  // start reading lobe labelmap and airwayTree concurrently; the tree is
+  // processed while the lobe labelmap is still loading
+  std::future<LabelmapType::Pointer> lobesFuture =
+    lapdMouse::ReadImageAsync<LabelmapType>( lobesFilename );
+  using SpatialObjectType = itk::SpatialObject<3>;
+  std::future<SpatialObjectType::Pointer> treeFuture =
+    lapdMouse::ReadTreeAsync( treeFilename );
+
+  // wait for airwayTree
+  SpatialObjectType::Pointer tree = treeFuture.get();
+
+  // search terminal airway segments and use their end points as seeds points
+  // to partition the lobes into compartments
+  TerminalSeedMapType terminalSeedMap;
+  SpatialObjectType::ChildrenListType* segments = tree->GetChildren(
+    SpatialObjectType::MaximumDepth, (char*)"VesselTubeSpatialObject");
+  using TubeType = itk::TubeSpatialObject<3>;
+  for (SpatialObjectType::ChildrenListType::iterator segmentIt = segments->begin();
+    segmentIt!=segments->end(); ++segmentIt)
+  {
+    TubeType::Pointer segment( dynamic_cast<TubeType*>(segmentIt->GetPointer()) );
+    if (segment->GetNumberOfChildren()==0) // terminal segment
+    {
+      PointType segmentEndPoint =
+        segment->GetPoint(segment->GetNumberOfPoints()-1)->GetPositionInObjectSpace();
+      terminalSeedMap[segment->GetId()] = segmentEndPoint;
+    }
+  }
+  delete segments;
+
+  // wait for lobe labelmap and shrink it for faster processing
+  using ShrinkImageFilterType = itk::ShrinkImageFilter< LabelmapType, LabelmapType >;
+  ShrinkImageFilterType::Pointer shrinkFilter = ShrinkImageFilterType::New();
+  shrinkFilter->SetShrinkFactors( shrinkfactor );
+  shrinkFilter->SetInput( lobesFuture.get() );
+  shrinkFilter->Update();
+  LabelmapType::Pointer lobes = shrinkFilter->GetOutput();
+
+  // initalize compartment image
+  CompartmentsType::Pointer compartments = CompartmentsType::New();
+  compartments->CopyInformation( lobes );
+  compartments->SetRegions( lobes->GetLargestPossibleRegion() );
+  compartments->Allocate();
+  compartments->FillBuffer(0);
+
+  // expand terminal compartment regions starting from seed points based on
+  // their distance to the seed point
+  if (parallelFill)
+    GrowCompartmentsPerLobe( lobes, compartments, terminalSeedMap );
+  else
+    GrowCompartments( lobes, compartments, terminalSeedMap );
+
+  // write terminal compartment labelmap; segment IDs are stored as dense
+  // ordinals with the narrowest pixel type possible together with a table
+  // mapping ordinals to segment IDs
+  lapdMouse::WriteCompactLabelmap( compartments.GetPointer(), outputFilename );
+  cache.Store( "labelmap", outputFilename );
+  cache.Store( "labels", labelTableFilename );
 
   return EXIT_SUCCESS;
 }
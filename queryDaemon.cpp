@@ -0,0 +1,529 @@
+/*
+Daemon answering queries about lapdMouse specimens over a local Unix socket.
+
+```bash
+./queryDaemon /tmp/lapdMouse.sock 4096
+echo "PATH m01_AirwayTree.meta 673" | nc -U /tmp/lapdMouse.sock
+```
+
+Instead of starting a tool such as accessTreeData, labelTreePathAndChildren,
+or mapOutlet2AirwaySegment for every query, which requires reading the tree
+structure and meshes again and again, the daemon loads each file once and
+keeps it resident. Resident data is identified by the files' names, sizes,
+and modification times, so files regenerated while the daemon is running are
+read again. When the memory used by resident data exceeds the given limit (in
+MB, 4096 by default), the least recently used data is released.
+
+Each request is a single line with a command and its arguments separated by
+whitespace. The response starts with a line `OK` or `ERROR: <message>`,
+followed by the result in a Comma Separated Value (CSV) format, and ends with
+an empty line. Supported commands:
+
+  * `PATH airwayTree segmentId`: IDs of segments from the trachea to segmentId
+  * `SUBTREE airwayTree segmentId`: IDs of segmentId and all its descendants
+  * `NEAREST airwayTree x y z`: segment with the closest centerline point
+  * `OUTLETS airwayOutletsMesh airwayTree`: mapping of outlets to segments as
+    output by mapOutlet2AirwaySegment
+  * `HIGHLIGHT airwaySegmentsMesh airwayTree segmentId highlightedSegmentsMesh`:
+    write mesh labeled as by labelTreePathAndChildren
+  * `LABELSTATS image labelmap [label]`: statistics of one or all labeled
+    regions as output by imageLabelStatistics
+  * `STATUS`: list of resident data and their approximate memory size
+*/
+
+#include <itkMesh.h>
+#include <itkMeshFileWriter.h>
+#include <itkSpatialObject.h>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "lapdMouseAsyncReader.h"
+#include "lapdMouseLabelStatistics.h"
+#include "lapdMouseTreeSegments.h"
+
+using MeshType = itk::Mesh< float, 3 >;
+
+// data kept resident by the daemon
+struct Resource
+{
+  virtual ~Resource() {}
+  size_t memorySize = 0;
+};
+
+// airway tree with lookup of segment index by ID
+struct TreeResource : public Resource
+{
+  lapdMouse::TreeSegments segments;
+  std::unordered_map<unsigned int, size_t> segmentIndices;
+};
+
+struct MeshResource : public Resource
+{
+  MeshType::Pointer mesh; // shared by concurrent queries; never modified
+};
+
+// rows of a CSV table by label
+struct TableResource : public Resource
+{
+  std::string header;
+  std::map<unsigned int, std::string> rows;
+};
+
+// resident data identified by a key; releases least recently used data when
+// exceeding the memory limit
+class ResourceCache
+{
+public:
+  explicit ResourceCache(size_t memoryLimit) : m_MemoryLimit(memoryLimit), m_MemoryUsage(0) {}
+
+  // return resident data for key or load it with loader
+  template <typename TResource, typename TLoader>
+  std::shared_ptr<TResource> Get(const std::string& key, TLoader loader)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      EntryMapType::iterator it = m_Entries.find(key);
+      if (it!=m_Entries.end())
+      {
+        m_Usage.splice(m_Usage.begin(), m_Usage, it->second.usage);
+        return std::static_pointer_cast<TResource>(it->second.resource);
+      }
+    }
+
+    // load without holding the lock, so other queries are answered meanwhile
+    std::shared_ptr<TResource> resource = loader();
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    EntryMapType::iterator it = m_Entries.find(key);
+    if (it!=m_Entries.end()) // loaded concurrently by another query
+      return std::static_pointer_cast<TResource>(it->second.resource);
+    m_Usage.push_front(key);
+    Entry& entry = m_Entries[key];
+    entry.resource = resource;
+    entry.usage = m_Usage.begin();
+    m_MemoryUsage += resource->memorySize;
+
+    // release least recently used data; data still in use by other queries
+    // is freed once these are answered
+    while (m_MemoryUsage>m_MemoryLimit && m_Usage.size()>1)
+    {
+      EntryMapType::iterator lru = m_Entries.find(m_Usage.back());
+      m_MemoryUsage -= lru->second.resource->memorySize;
+      m_Entries.erase(lru);
+      m_Usage.pop_back();
+    }
+    return resource;
+  }
+
+  void WriteStatus(std::ostream& stream)
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    stream << "key,memorySize" << std::endl;
+    for (std::list<std::string>::const_iterator it=m_Usage.begin(); it!=m_Usage.end(); ++it)
+      stream << *it << "," << m_Entries[*it].resource->memorySize << std::endl;
+  }
+
+private:
+  struct Entry
+  {
+    std::shared_ptr<Resource> resource;
+    std::list<std::string>::iterator usage;
+  };
+  using EntryMapType = std::unordered_map<std::string, Entry>;
+
+  std::mutex m_Mutex;
+  EntryMapType m_Entries;
+  std::list<std::string> m_Usage; // most recently used first
+  size_t m_MemoryLimit;
+  size_t m_MemoryUsage;
+};
+
+// identifies the current version of a file by its name, size, and
+// modification time (with nanoseconds, so that files rewritten within a second
+// are told apart); part of the keys of resident data, so that data of modified
+// files is not reused
+std::string GetFileKey(const std::string& filename)
+{
+  std::ostringstream key;
+  key << filename;
+  struct stat fileStatus;
+  if (stat(filename.c_str(), &fileStatus)==0)
+  {
+#if defined(__APPLE__)
+    const struct timespec& modificationTime = fileStatus.st_mtimespec;
+#else
+    const struct timespec& modificationTime = fileStatus.st_mtim;
+#endif
+    key << "@" << fileStatus.st_size << "@" << modificationTime.tv_sec
+      << "." << modificationTime.tv_nsec;
+  }
+  else
+    key << "@missing";
+  return key.str();
+}
+
+std::shared_ptr<TreeResource> GetTree(ResourceCache& cache, const std::string& filename)
+{
+  return cache.Get<TreeResource>( "tree:"+GetFileKey(filename), [&]()
+  {
+    std::shared_ptr<TreeResource> tree = std::make_shared<TreeResource>();
+    itk::SpatialObject<3>::Pointer treeObject = lapdMouse::ReadTreeAsync( filename ).get();
+    tree->segments = lapdMouse::FlattenTree( treeObject.GetPointer(), false );
+    const lapdMouse::TreeSegments& segments = tree->segments;
+    const size_t numberOfSegments = segments.GetNumberOfSegments();
+    for (size_t s=0; s<numberOfSegments; ++s)
+      tree->segmentIndices[segments.ids[s]] = s;
+    tree->memorySize = segments.x.size()*4*sizeof(float)+numberOfSegments*128;
+    return tree;
+  });
+}
+
+std::shared_ptr<MeshResource> GetMesh(ResourceCache& cache, const std::string& filename)
+{
+  return cache.Get<MeshResource>( "mesh:"+GetFileKey(filename), [&]()
+  {
+    std::shared_ptr<MeshResource> mesh = std::make_shared<MeshResource>();
+    mesh->mesh = lapdMouse::ReadMeshAsync<MeshType>( filename ).get();
+    mesh->memorySize = mesh->mesh->GetNumberOfPoints()*(sizeof(MeshType::PointType)+
+      sizeof(MeshType::PixelType))+mesh->mesh->GetNumberOfCells()*96;
+    return mesh;
+  });
+}
+
+size_t GetSegmentIndex(const TreeResource& tree, const std::string& segmentId)
+{
+  std::unordered_map<unsigned int, size_t>::const_iterator it =
+    tree.segmentIndices.find( std::stoul(segmentId) );
+  if (it==tree.segmentIndices.end())
+    throw std::runtime_error("tree does not contain segment with given id: "+segmentId);
+  return it->second;
+}
+
+// indices of segments from the trachea to segment
+std::vector<size_t> GetPath(const TreeResource& tree, size_t segment)
+{
+  std::vector<size_t> path;
+  for (int s=int(segment); s>=0; s=tree.segments.parents[s])
+    path.push_back(s);
+  std::reverse(path.begin(), path.end());
+  return path;
+}
+
+// indices of segment and all its descendants
+std::vector<size_t> GetSubtree(const TreeResource& tree, size_t segment)
+{
+  std::vector<size_t> subtree(1, segment);
+  for (size_t i=0; i<subtree.size(); ++i)
+    for (size_t c=tree.segments.childOffsets[subtree[i]];
+      c<tree.segments.childOffsets[subtree[i]+1]; ++c)
+      subtree.push_back(tree.segments.children[c]);
+  return subtree;
+}
+
+// answer a single request
+void AnswerRequest(ResourceCache& cache, const std::vector<std::string>& request,
+  std::ostream& response)
+{
+  const std::string command = request.empty() ? "" : request[0];
+  if (command=="PATH" && request.size()==3)
+  {
+    std::shared_ptr<TreeResource> tree = GetTree( cache, request[1] );
+    std::vector<size_t> path = GetPath( *tree, GetSegmentIndex(*tree, request[2]) );
+    response << "segmentId" << std::endl;
+    for (size_t i=0; i<path.size(); ++i)
+      response << tree->segments.ids[path[i]] << std::endl;
+  }
+  else if (command=="SUBTREE" && request.size()==3)
+  {
+    std::shared_ptr<TreeResource> tree = GetTree( cache, request[1] );
+    std::vector<size_t> subtree = GetSubtree( *tree, GetSegmentIndex(*tree, request[2]) );
+    response << "segmentId" << std::endl;
+    for (size_t i=0; i<subtree.size(); ++i)
+      response << tree->segments.ids[subtree[i]] << std::endl;
+  }
+  else if (command=="NEAREST" && request.size()==5)
+  {
+    std::shared_ptr<TreeResource> tree = GetTree( cache, request[1] );
+    const lapdMouse::TreeSegments& segments = tree->segments;
+    const float x = std::stof(request[2]), y = std::stof(request[3]), z = std::stof(request[4]);
+    float closestDistance2 = std::numeric_limits<float>::max();
+    size_t closestPoint = 0;
+    for (size_t p=0; p<segments.x.size(); ++p)
+    {
+      const float dx = segments.x[p]-x, dy = segments.y[p]-y, dz = segments.z[p]-z;
+      const float distance2 = dx*dx+dy*dy+dz*dz;
+      if (distance2<closestDistance2)
+      {
+        closestDistance2 = distance2;
+        closestPoint = p;
+      }
+    }
+    if (segments.x.empty())
+      throw std::runtime_error("tree does not contain centerline points");
+    const size_t segment = std::upper_bound(segments.pointOffsets.begin(),
+      segments.pointOffsets.end(), closestPoint)-segments.pointOffsets.begin()-1;
+    response << "segmentId,distance" << std::endl;
+    response << segments.ids[segment] << "," << std::sqrt(closestDistance2) << std::endl;
+  }
+  else if (command=="OUTLETS" && request.size()==3)
+  {
+    std::shared_ptr<TableResource> table = cache.Get<TableResource>(
+      "outlets:"+GetFileKey(request[1])+":"+GetFileKey(request[2]), [&]()
+    {
+      // obtain center of each outlet region and assign closest segment
+      std::shared_ptr<MeshResource> mesh = GetMesh( cache, request[1] );
+      std::shared_ptr<TreeResource> tree = GetTree( cache, request[2] );
+      std::map<unsigned int, std::pair<MeshType::PointType::VectorType, size_t> > centers;
+      const MeshType::PointsContainer* points = mesh->mesh->GetPoints();
+      const MeshType::PointDataContainer* pointData = mesh->mesh->GetPointData();
+      MeshType::PointsContainer::ConstIterator pointIt = points->Begin();
+      MeshType::PointDataContainer::ConstIterator pointDataIt = pointData->Begin();
+      for (; pointDataIt!=pointData->End(); ++pointIt, ++pointDataIt)
+      {
+        unsigned int outletId = (unsigned int)pointDataIt.Value();
+        if (outletId==0) // a mesh value of 0 indicates airway wall
+          continue;
+        std::pair<MeshType::PointType::VectorType, size_t>& center = centers[outletId];
+        if (center.second==0)
+          center.first.Fill(0);
+        center.first += pointIt.Value().GetVectorFromOrigin();
+        ++center.second;
+      }
+      const lapdMouse::TreeSegments& segments = tree->segments;
+      std::shared_ptr<TableResource> result = std::make_shared<TableResource>();
+      result->header = "outletId,segmentId";
+      for (auto it=centers.begin(); it!=centers.end(); ++it)
+      {
+        MeshType::PointType::VectorType center = it->second.first/double(it->second.second);
+        float closestDistance2 = std::numeric_limits<float>::max();
+        size_t closestSegment = 0;
+        for (size_t s=0; s<segments.GetNumberOfSegments(); ++s)
+          for (size_t p=segments.pointOffsets[s]; p<segments.pointOffsets[s+1]; ++p)
+          {
+            const float dx = segments.x[p]-center[0];
+            const float dy = segments.y[p]-center[1];
+            const float dz = segments.z[p]-center[2];
+            const float distance2 = dx*dx+dy*dy+dz*dz;
+            if (distance2<closestDistance2)
+            {
+              closestDistance2 = distance2;
+              closestSegment = s;
+            }
+          }
+        std::ostringstream row;
+        row << it->first << "," << segments.ids[closestSegment];
+        result->rows[it->first] = row.str();
+      }
+      result->memorySize = result->rows.size()*64;
+      return result;
+    });
+    response << table->header << std::endl;
+    for (auto it=table->rows.begin(); it!=table->rows.end(); ++it)
+      response << it->second << std::endl;
+  }
+  else if (command=="HIGHLIGHT" && request.size()==5)
+  {
+    std::shared_ptr<MeshResource> mesh = GetMesh( cache, request[1] );
+    std::shared_ptr<TreeResource> tree = GetTree( cache, request[2] );
+    const size_t segment = GetSegmentIndex( *tree, request[3] );
+    const unsigned int segmentId = tree->segments.ids[segment];
+    std::set<unsigned int> parentSegmentIds, childSegmentIds;
+    std::vector<size_t> path = GetPath( *tree, segment );
+    for (size_t i=0; i+1<path.size(); ++i)
+      parentSegmentIds.insert(tree->segments.ids[path[i]]);
+    std::vector<size_t> subtree = GetSubtree( *tree, segment );
+    for (size_t i=1; i<subtree.size(); ++i)
+      childSegmentIds.insert(tree->segments.ids[subtree[i]]);
+
+    // assign labeling to mesh point data as labelTreePathAndChildren does:
+    // 1: user specified segment, 2: segments on path from root, 3: child
+    // segments, 0: other segments
+    const MeshType::PointDataContainer* segmentData = mesh->mesh->GetPointData();
+    MeshType::PointDataContainer::Pointer labelData = MeshType::PointDataContainer::New();
+    labelData->Reserve( segmentData->Size() );
+    MeshType::PointDataContainer::Iterator labelIt = labelData->Begin();
+    for (MeshType::PointDataContainer::ConstIterator it=segmentData->Begin();
+      it!=segmentData->End(); ++it, ++labelIt)
+    {
+      unsigned int currentSegmentId = (unsigned int)it.Value();
+      unsigned int label = 0;
+      if (currentSegmentId==segmentId)
+        label = 1;
+      else if (parentSegmentIds.find(currentSegmentId)!=parentSegmentIds.end())
+        label = 2;
+      else if (childSegmentIds.find(currentSegmentId)!=childSegmentIds.end())
+        label = 3;
+      labelIt.Value() = label;
+    }
+
+    // write mesh with labels; the output mesh shares points and cells with
+    // the resident mesh, which other queries may read meanwhile, but has
+    // point data of its own
+    MeshType::Pointer highlightedMesh = MeshType::New();
+    highlightedMesh->SetPoints( mesh->mesh->GetPoints() );
+    highlightedMesh->SetCells( mesh->mesh->GetCells() );
+    highlightedMesh->SetPointData( labelData );
+    using WriterType = itk::MeshFileWriter<MeshType>;
+    WriterType::Pointer writer = WriterType::New();
+    writer->SetInput( highlightedMesh );
+    writer->SetFileName( request[4] );
+    writer->SetUseCompression( true );
+    writer->Update();
+    response << "highlightedSegmentsMesh" << std::endl << request[4] << std::endl;
+  }
+  else if (command=="LABELSTATS" && (request.size()==3 || request.size()==4))
+  {
+    std::shared_ptr<TableResource> table = cache.Get<TableResource>(
+      "labelstats:"+GetFileKey(request[1])+":"+GetFileKey(request[2])+":"+
+      GetFileKey(lapdMouse::GetLabelTableFilename(request[2])), [&]()
+    {
+      // statistics of all labels are calculated at once; only the resulting
+      // table needs to be kept resident
+      std::stringstream csv;
+      lapdMouse::WriteLabelStatistics( request[1], request[2], csv );
+      std::shared_ptr<TableResource> result = std::make_shared<TableResource>();
+      std::getline(csv, result->header);
+      std::string row;
+      while (std::getline(csv, row))
+        result->rows[std::stoul(row.substr(0, row.find(',')))] = row;
+      result->memorySize = result->rows.size()*128;
+      return result;
+    });
+    response << table->header << std::endl;
+    if (request.size()==4)
+    {
+      auto it = table->rows.find( std::stoul(request[3]) );
+      if (it==table->rows.end())
+        throw std::runtime_error("labelmap does not contain label: "+request[3]);
+      response << it->second << std::endl;
+    }
+    else
+      for (auto it=table->rows.begin(); it!=table->rows.end(); ++it)
+        response << it->second << std::endl;
+  }
+  else if (command=="STATUS" && request.size()==1)
+    cache.WriteStatus(response);
+  else
+    throw std::runtime_error("invalid request");
+}
+
+// answer requests of one client until it closes the connection
+void ServeClient(ResourceCache& cache, int connection)
+{
+  std::string buffer;
+  char data[4096];
+  ssize_t received;
+  while ((received = recv(connection, data, sizeof(data), 0))>0)
+  {
+    buffer.append(data, received);
+    size_t lineEnd;
+    while ((lineEnd = buffer.find('\n'))!=std::string::npos)
+    {
+      std::istringstream line(buffer.substr(0, lineEnd));
+      buffer.erase(0, lineEnd+1);
+      std::vector<std::string> request;
+      std::string token;
+      while (line >> token)
+        request.push_back(token);
+      if (request.empty())
+        continue;
+
+      std::ostringstream result;
+      std::string response;
+      try
+      {
+        AnswerRequest(cache, request, result);
+        response = "OK\n"+result.str()+"\n";
+      }
+      catch (itk::ExceptionObject& e)
+      {
+        response = std::string("ERROR: ")+e.GetDescription()+"\n\n";
+      }
+      catch (std::exception& e)
+      {
+        response = std::string("ERROR: ")+e.what()+"\n\n";
+      }
+      for (size_t sent=0; sent<response.size(); )
+      {
+        ssize_t count = send(connection, response.data()+sent, response.size()-sent, 0);
+        if (count<=0)
+          break;
+        sent += count;
+      }
+    }
+  }
+  close(connection);
+}
+
+int main(int argc, char**argv)
+{
+  if (argc!=2 && argc!=3)
+  {
+    std::cerr << "Usage: " << argv[0] << " socket [memoryLimitMB]" << std::endl;
+    return -1;
+  }
+
+  std::string socketFilename = argv[1];
+  size_t memoryLimit = size_t(argc==3 ? atoi(argv[2]) : 4096)*1024*1024;
+  ResourceCache cache(memoryLimit);
+
+  // clients closing their connection early must not terminate the daemon
+  signal(SIGPIPE, SIG_IGN);
+
+  // listen on local Unix socket
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socketFilename.size()>=sizeof(address.sun_path))
+  {
+    std::cerr << "socket path too long: " << socketFilename << std::endl;
+    return EXIT_FAILURE;
+  }
+  strncpy(address.sun_path, socketFilename.c_str(), sizeof(address.sun_path)-1);
+  // remove a socket left over by a previous run, but never other files
+  struct stat socketStatus;
+  if (lstat(socketFilename.c_str(), &socketStatus)==0)
+  {
+    if (!S_ISSOCK(socketStatus.st_mode))
+    {
+      std::cerr << "not a socket, refusing to replace: " << socketFilename << std::endl;
+      return EXIT_FAILURE;
+    }
+    unlink(socketFilename.c_str());
+  }
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server<0 || bind(server, (sockaddr*)&address, sizeof(address))<0 ||
+    listen(server, 16)<0)
+  {
+    std::cerr << "unable to listen on socket " << socketFilename << ": "
+      << strerror(errno) << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // serve every client on its own thread
+  while (true)
+  {
+    int connection = accept(server, nullptr, nullptr);
+    if (connection<0)
+      continue;
+    std::thread(ServeClient, std::ref(cache), connection).detach();
+  }
+
+  return EXIT_SUCCESS;
+}
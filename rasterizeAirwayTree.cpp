@@ -0,0 +1,171 @@
+/*
+Tool to rasterize the airway segments of AirwayTree.meta into a labelmap of
+segment IDs.
+
+```bash
+./rasterizeAirwayTree m01_AerosolSub2.mha m01_AirwayTree.meta m01_AirwayTreeLabels.nrrd
+```
+
+The labelmap's grid (origin, spacing, direction, size) is taken from a
+reference image, e.g. an intensity image. Every airway segment is represented
+as a chain of capsules connecting consecutive centerline points, with the
+radius interpolated linearly between them (see lapdMouseCapsules.h). A voxel
+is assigned the segment whose capsule surface it lies deepest in; ties are
+resolved in favor of the lower segment ID. For parallel processing the image is split into slabs along
+the z-axis, each capsule is binned into the slabs its bounding box overlaps,
+and slabs are rasterized concurrently without shared writes. The labelmap is
+stored compressed as dense ordinals with a table mapping ordinals to segment
+IDs (e.g. m01_AirwayTreeLabelsLabels.csv).
+*/
+
+#include <itkImage.h>
+#include <itkImageFileReader.h>
+#include <itkMultiThreaderBase.h>
+#include <itkSpatialObject.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "lapdMouseAsyncReader.h"
+#include "lapdMouseCapsules.h"
+#include "lapdMouseCompactLabelmap.h"
+#include "lapdMouseImageSampler.h"
+#include "lapdMouseTreeSegments.h"
+
+int main(int argc, char**argv)
+{
+  if (argc!=4)
+  {
+    std::cerr << "Usage: " << argv[0] << " referenceImage airwayTree airwayLabelmap" << std::endl;
+    return -1;
+  }
+
+  // start reading airwayTree
+  using SpatialObjectType = itk::SpatialObject<3>;
+  std::string treeFilename = argv[2];
+  std::future<SpatialObjectType::Pointer> treeFuture =
+    lapdMouse::ReadTreeAsync( treeFilename );
+
+  // read grid information of reference image; its pixel data is not needed
+  using LabelmapType = itk::Image< unsigned int, 3 >;
+  using ReaderType = itk::ImageFileReader<LabelmapType>;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( argv[1] );
+  reader->UpdateOutputInformation();
+  LabelmapType::Pointer labelmap = LabelmapType::New();
+  labelmap->CopyInformation( reader->GetOutput() );
+  labelmap->SetRegions( reader->GetOutput()->GetLargestPossibleRegion() );
+  labelmap->Allocate();
+  labelmap->FillBuffer(0);
+
+  // convert centerline points of segments into capsules; each segment starts
+  // at its parent's connection point
+  SpatialObjectType::Pointer tree = treeFuture.get();
+  const lapdMouse::TreeSegments segments =
+    lapdMouse::FlattenTree( tree.GetPointer(), true );
+  const std::vector<lapdMouse::Capsule> capsules = lapdMouse::CreateCapsules( segments );
+
+  // transforms between physical space and buffer indices
+  const LabelmapType::RegionType region = labelmap->GetLargestPossibleRegion();
+  const long size[3] = { long(region.GetSize()[0]), long(region.GetSize()[1]),
+    long(region.GetSize()[2]) };
+  const long start[3] = { region.GetIndex()[0], region.GetIndex()[1],
+    region.GetIndex()[2] };
+  const lapdMouse::PhysicalToIndexTransform physicalToIndex( labelmap.GetPointer() );
+  const LabelmapType::DirectionType& indexToPhysical =
+    labelmap->GetIndexToPhysicalPointMatrix();
+  const LabelmapType::PointType& origin = labelmap->GetOrigin();
+
+  // determine voxel bounding box of each capsule and bin capsules into slabs
+  const long slabThickness = 8;
+  const long numberOfSlabs = (size[2]+slabThickness-1)/slabThickness;
+  std::vector<std::vector<size_t> > slabCapsules(numberOfSlabs);
+  std::vector<long> capsuleBounds(capsules.size()*6);
+  for (size_t c=0; c<capsules.size(); ++c)
+  {
+    const lapdMouse::Capsule& capsule = capsules[c];
+    const float radius = std::max(capsule.radiusA, capsule.radiusB);
+    float lower[3], upper[3];
+    for (unsigned int d=0; d<3; ++d)
+    {
+      lower[d] = std::min(capsule.a[d], capsule.b[d])-radius;
+      upper[d] = std::max(capsule.a[d], capsule.b[d])+radius;
+    }
+    // transform corners of physical bounding box into index space
+    float indexLower[3] = { std::numeric_limits<float>::max(),
+      std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+    float indexUpper[3] = { std::numeric_limits<float>::lowest(),
+      std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+    for (unsigned int corner=0; corner<8; ++corner)
+    {
+      const float x = corner&1 ? upper[0] : lower[0];
+      const float y = corner&2 ? upper[1] : lower[1];
+      const float z = corner&4 ? upper[2] : lower[2];
+      float index[3];
+      physicalToIndex.TransformPoints(&x, &y, &z, 1, index, index+1, index+2);
+      for (unsigned int d=0; d<3; ++d)
+      {
+        indexLower[d] = std::min(indexLower[d], index[d]);
+        indexUpper[d] = std::max(indexUpper[d], index[d]);
+      }
+    }
+    bool inside = true;
+    long* bounds = &capsuleBounds[c*6];
+    for (unsigned int d=0; d<3; ++d)
+    {
+      bounds[d] = std::max(long(std::floor(indexLower[d]))-start[d], 0L);
+      bounds[d+3] = std::min(long(std::ceil(indexUpper[d]))-start[d], size[d]-1);
+      inside = inside && bounds[d]<=bounds[d+3];
+    }
+    if (!inside)
+      continue; // capsule outside of image
+    for (long slab=bounds[2]/slabThickness; slab<=bounds[5]/slabThickness; ++slab)
+      slabCapsules[slab].push_back(c);
+  }
+
+  // rasterize slabs in parallel; within a slab, capsules are processed in
+  // order of their segment ID and only replace a voxel's label if it lies
+  // strictly deeper inside, which makes the result deterministic
+  LabelmapType::PixelType* labels = labelmap->GetBufferPointer();
+  itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+  threader->ParallelizeArray( 0, numberOfSlabs,
+    [&](itk::SizeValueType slab)
+    {
+      const long slabBegin = long(slab)*slabThickness;
+      const long slabEnd = std::min(slabBegin+slabThickness, size[2]);
+      std::vector<float> depth(size[0]*size[1]*(slabEnd-slabBegin),
+        std::numeric_limits<float>::max());
+      for (size_t c : slabCapsules[slab])
+      {
+        const lapdMouse::Capsule& capsule = capsules[c];
+        const long* bounds = &capsuleBounds[c*6];
+        const unsigned int segmentId = segments.ids[capsule.segment];
+        for (long k=std::max(bounds[2], slabBegin); k<=std::min(bounds[5], slabEnd-1); ++k)
+          for (long j=bounds[1]; j<=bounds[4]; ++j)
+          {
+            float* depthRow = &depth[((k-slabBegin)*size[1]+j)*size[0]];
+            LabelmapType::PixelType* labelRow = labels+(k*size[1]+j)*size[0];
+            for (long i=bounds[0]; i<=bounds[3]; ++i)
+            {
+              // physical position of voxel center
+              float point[3];
+              for (unsigned int d=0; d<3; ++d)
+                point[d] = float(origin[d]+indexToPhysical[d][0]*(i+start[0])+
+                  indexToPhysical[d][1]*(j+start[1])+
+                  indexToPhysical[d][2]*(k+start[2]));
+              const float surfaceDistance = lapdMouse::GetSignedDistance( capsule, point );
+              if (surfaceDistance<=0 && surfaceDistance<depthRow[i])
+              {
+                depthRow[i] = surfaceDistance;
+                labelRow[i] = segmentId;
+              }
+            }
+          }
+      }
+    }, nullptr );
+
+  // write airway labelmap compressed with dense ordinals
+  std::string outputFilename = argv[3];
+  lapdMouse::WriteCompactLabelmap( labelmap.GetPointer(), outputFilename );
+
+  return EXIT_SUCCESS;
+}
@@ -4,38 +4,54 @@ Example how to read and write intensity images used in lapdMouse project using I
 ```bash
 ./readWriteImage m01_AerosolSub2.mha out.mha
 ```
+
+The image is processed with the pixel type it is stored with on disk, i.e.
+no conversion takes place during reading and writing.
 */
 
 // ITK includes
 #include <itkImage.h>
 #include <itkImageFileReader.h>
 #include <itkImageFileWriter.h>
+#include "lapdMouseImageTypeDispatch.h"
 
-int main(int argc, char**argv)
+// read and write image with pixel type TPixel
+template <typename TPixel>
+void ReadWriteImage(const std::string& inputFilename, const std::string& outputFilename)
 {
-  if (argc!=3)
-  {
-    std::cerr << "Usage: " << argv[0] << " input output" << std::endl;
-    return -1;
-  }
-  
   // typedef for volumetric images used in lapdMouse project
-  typedef itk::Image< float, 3 > ImageType;
-  
+  typedef itk::Image< TPixel, 3 > ImageType;
+
   // read image
-  std::string inputFilename = argv[1];
   typedef itk::ImageFileReader<ImageType> ReaderType;
-  ReaderType::Pointer reader = ReaderType::New();
+  typename ReaderType::Pointer reader = ReaderType::New();
   reader->SetFileName( inputFilename.c_str() );
   reader->Update();
-  ImageType::Pointer image = reader->GetOutput();
-  
+  typename ImageType::Pointer image = reader->GetOutput();
+
   // write image
-  std::string outputFilename = argv[2];
   typedef itk::ImageFileWriter<ImageType> WriterType;
-  WriterType::Pointer writer = WriterType::New();
+  typename WriterType::Pointer writer = WriterType::New();
   writer->SetInput( image );
   writer->SetFileName( outputFilename.c_str() );
-  writer->Update();  
+  writer->Update();
 }
 
+int main(int argc, char**argv)
+{
+  if (argc!=3)
+  {
+    std::cerr << "Usage: " << argv[0] << " input output" << std::endl;
+    return -1;
+  }
+
+  std::string inputFilename = argv[1];
+  std::string outputFilename = argv[2];
+
+  // inspect the file's pixel type and instantiate ReadWriteImage accordingly
+  lapdMouse::DispatchOnPixelType( inputFilename, [&](auto tag)
+  {
+    using PixelType = typename decltype(tag)::Type;
+    ReadWriteImage<PixelType>( inputFilename, outputFilename );
+  });
+}
@@ -4,38 +4,61 @@ Example how to read and write labelmaps used in lapdMouse project using ITK.
 ```bash
 ./readWriteLabelmap m01_NearAcini.nrrd out.nrrd
 ```
+
+Labelmaps with sparse labels (e.g. TerminalCompartments.nrrd) are stored as
+dense ordinals with a table mapping ordinals to labels next to the labelmap
+(e.g. m01_TerminalCompartmentsLabels.csv). The table is copied along.
 */
 
 // ITK includes
 #include <itkImage.h>
 #include <itkImageFileReader.h>
 #include <itkImageFileWriter.h>
+#include "lapdMouseCompactLabelmap.h"
 
-int main(int argc, char**argv)
+// read and write labelmap with pixel type TLabel
+template <typename TLabel>
+void ReadWriteLabelmap(const std::string& inputFilename, const std::string& outputFilename)
 {
-  if (argc!=3)
-  {
-    std::cerr << "Usage: " << argv[0] << " input output" << std::endl;
-    return -1;
-  }
-
   // typedef for volumetric labelmaps used in lapdMouse project
-  typedef itk::Image< unsigned short, 3 > LabelmapType;
+  typedef itk::Image< TLabel, 3 > LabelmapType;
 
   // read labelmap
-  std::string inputFilename = argv[1];
   typedef itk::ImageFileReader<LabelmapType> ReaderType;
-  ReaderType::Pointer reader = ReaderType::New();
+  typename ReaderType::Pointer reader = ReaderType::New();
   reader->SetFileName( inputFilename.c_str() );
   reader->Update();
-  LabelmapType::Pointer labelmap = reader->GetOutput();
+  typename LabelmapType::Pointer labelmap = reader->GetOutput();
 
   // write labelmap
-  std::string outputFilename = argv[2];
   typedef itk::ImageFileWriter<LabelmapType> WriterType;
-  WriterType::Pointer writer = WriterType::New();
+  typename WriterType::Pointer writer = WriterType::New();
   writer->SetInput( labelmap );
   writer->SetFileName( outputFilename.c_str() );
   writer->SetUseCompression( true ); // labelmaps can get compressed efficiently
   writer->Update();
+
+  // copy table mapping ordinals to labels if there is one
+  lapdMouse::CompactLabelTable labelTable = lapdMouse::ReadLabelTable( inputFilename );
+  if (!labelTable.IsIdentity())
+    labelTable.Write( lapdMouse::GetLabelTableFilename(outputFilename) );
+}
+
+int main(int argc, char**argv)
+{
+  if (argc!=3)
+  {
+    std::cerr << "Usage: " << argv[0] << " input output" << std::endl;
+    return -1;
+  }
+
+  std::string inputFilename = argv[1];
+  std::string outputFilename = argv[2];
+
+  // labelmaps are unsigned short unless more labels need to be stored
+  lapdMouse::DispatchOnLabelPixelType( inputFilename, [&](auto tag)
+  {
+    using LabelType = typename decltype(tag)::Type;
+    ReadWriteLabelmap<LabelType>( inputFilename, outputFilename );
+  });
 }
@@ -0,0 +1,186 @@
+/*
+Tool to sample an intensity image along the centerlines of all airway segments
+in AirwayTree.meta.
+
+```bash
+./sampleCenterlineIntensities m01_AerosolSub2.mha m01_AirwayTree.meta m01_CenterlineIntensities.csv m01_SegmentIntensities.csv
+```
+
+For every centerline point the image is sampled with trilinear interpolation
+(a) at the centerline point itself and (b) at a set of points within a sphere
+with the centerline point's radius. The per-point intensity profiles are
+written to the first Comma Separated Value (CSV) table, the per-segment
+averages along the centerline and within the tube's radius to the second one.
+Segments are processed in parallel.
+*/
+
+#include <itkImage.h>
+#include <itkMultiThreaderBase.h>
+#include <itkSpatialObject.h>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include "lapdMouseAsyncReader.h"
+#include "lapdMouseImageTypeDispatch.h"
+#include "lapdMouseImageSampler.h"
+#include "lapdMouseTreeSegments.h"
+
+// accumulated samples of one airway segment
+struct SegmentSamples
+{
+  double centerlineSum = 0;
+  size_t centerlineCount = 0;
+  double tubeSum = 0;
+  size_t tubeCount = 0;
+  float tubeMin = std::numeric_limits<float>::max();
+  float tubeMax = std::numeric_limits<float>::lowest();
+};
+
+// sample an intensity image with pixel type TPixel along the tree's centerlines
+template <typename TPixel>
+void SampleCenterlines(const std::string& imageFilename, const std::string& treeFilename,
+  const std::string& pointTableFilename, const std::string& segmentTableFilename)
+{
+  // start reading intensity image and airwayTree concurrently
+  using ImageType = itk::Image< TPixel, 3 >;
+  std::future<typename ImageType::Pointer> imageFuture =
+    lapdMouse::ReadImageAsync<ImageType>( imageFilename );
+  using SpatialObjectType = itk::SpatialObject<3>;
+  std::future<SpatialObjectType::Pointer> treeFuture =
+    lapdMouse::ReadTreeAsync( treeFilename );
+
+  // flatten tree into contiguous centerline point arrays while the image is
+  // still loading
+  SpatialObjectType::Pointer tree = treeFuture.get();
+  const lapdMouse::TreeSegments segments =
+    lapdMouse::FlattenTree( tree.GetPointer(), false );
+  const size_t numberOfSegments = segments.GetNumberOfSegments();
+  const size_t numberOfPoints = segments.x.size();
+
+  typename ImageType::Pointer image = imageFuture.get();
+  const lapdMouse::TrilinearSampler<ImageType> sampler( image.GetPointer() );
+
+  // sample offsets on a regular grid within a sphere of radius 1
+  std::vector<float> sphereX, sphereY, sphereZ;
+  for (int k=-2; k<=2; ++k)
+    for (int j=-2; j<=2; ++j)
+      for (int i=-2; i<=2; ++i)
+        if (i*i+j*j+k*k<=4)
+        {
+          sphereX.push_back(0.5f*i);
+          sphereY.push_back(0.5f*j);
+          sphereZ.push_back(0.5f*k);
+        }
+  const size_t sphereSize = sphereX.size();
+
+  // sample every segment's centerline points and the spheres around them
+  std::vector<float> centerlineValues(numberOfPoints);
+  std::vector<float> tubeMeans(numberOfPoints);
+  std::vector<SegmentSamples> segmentSamples(numberOfSegments);
+  itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+  threader->ParallelizeArray( 0, numberOfSegments,
+    [&](itk::SizeValueType s)
+    {
+      const size_t first = segments.pointOffsets[s];
+      const size_t count = segments.GetNumberOfPoints(s);
+      SegmentSamples& samples = segmentSamples[s];
+      sampler.Sample( segments.x.data()+first, segments.y.data()+first,
+        segments.z.data()+first, count, centerlineValues.data()+first );
+
+      std::vector<float> x(sphereSize), y(sphereSize), z(sphereSize);
+      std::vector<float> values(sphereSize);
+      for (size_t p=first; p<first+count; ++p)
+      {
+        if (!std::isnan(centerlineValues[p]))
+        {
+          samples.centerlineSum += centerlineValues[p];
+          ++samples.centerlineCount;
+        }
+
+        const float radius = segments.radius[p];
+        for (size_t i=0; i<sphereSize; ++i)
+        {
+          x[i] = segments.x[p]+radius*sphereX[i];
+          y[i] = segments.y[p]+radius*sphereY[i];
+          z[i] = segments.z[p]+radius*sphereZ[i];
+        }
+        sampler.Sample( x.data(), y.data(), z.data(), sphereSize, values.data() );
+        double sum = 0;
+        size_t valid = 0;
+        for (size_t i=0; i<sphereSize; ++i)
+        {
+          if (std::isnan(values[i]))
+            continue;
+          sum += values[i];
+          ++valid;
+          samples.tubeMin = std::min(samples.tubeMin, values[i]);
+          samples.tubeMax = std::max(samples.tubeMax, values[i]);
+        }
+        tubeMeans[p] = valid>0 ? float(sum/valid) : std::numeric_limits<float>::quiet_NaN();
+        samples.tubeSum += sum;
+        samples.tubeCount += valid;
+      }
+    }, nullptr );
+
+  // write per-point intensity profiles
+  std::ofstream pointFile;
+  pointFile.open( pointTableFilename.c_str() );
+  pointFile << "segmentId,pointIndex,x,y,z,radius,centerlineIntensity,tubeIntensity" << std::endl;
+  for (size_t s=0; s<numberOfSegments; ++s)
+  {
+    const size_t first = segments.pointOffsets[s];
+    for (size_t p=first; p<segments.pointOffsets[s+1]; ++p)
+      pointFile << segments.ids[s] << "," << p-first << ","
+        << segments.x[p] << "," << segments.y[p] << "," << segments.z[p] << ","
+        << segments.radius[p] << ","
+        << centerlineValues[p] << "," << tubeMeans[p] << std::endl;
+  }
+  pointFile.close();
+
+  // write per-segment averages
+  std::ofstream segmentFile;
+  segmentFile.open( segmentTableFilename.c_str() );
+  segmentFile << "segmentId,numberOfPoints,centerlineMean,tubeMean,tubeMin,tubeMax,tubeSamples" << std::endl;
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  for (size_t s=0; s<numberOfSegments; ++s)
+  {
+    const SegmentSamples& samples = segmentSamples[s];
+    const bool hasTubeSamples = samples.tubeCount>0;
+    segmentFile << segments.ids[s] << "," << segments.GetNumberOfPoints(s) << ","
+      << (samples.centerlineCount>0 ? samples.centerlineSum/samples.centerlineCount : nan) << ","
+      << (hasTubeSamples ? samples.tubeSum/samples.tubeCount : nan) << ","
+      << (hasTubeSamples ? samples.tubeMin : nan) << ","
+      << (hasTubeSamples ? samples.tubeMax : nan) << ","
+      << samples.tubeCount << std::endl;
+  }
+  segmentFile.close();
+}
+
+int main(int argc, char**argv)
+{
+  if (argc!=5)
+  {
+    std::cerr << "Usage: " << argv[0] << " image airwayTree pointTable segmentTable" << std::endl;
+    return -1;
+  }
+
+  try
+  {
+    std::string imageFilename = argv[1];
+    std::string treeFilename = argv[2];
+
+    // sample the intensity image with the pixel type it is stored with
+    lapdMouse::DispatchOnPixelType( imageFilename, [&](auto tag)
+    {
+      using PixelType = typename decltype(tag)::Type;
+      SampleCenterlines<PixelType>( imageFilename, treeFilename, argv[3], argv[4] );
+    });
+  }
+  catch( itk::ExceptionObject & e )
+  {
+    std::cout << e << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -7,6 +7,10 @@ Excel.
 ```bash
 ./simplfyTree m01_AirwayTree.meta m01_AirwayTreeTable.csv
 ```
+
+With the optional flag `--morphometry`, additional columns with arc length,
+minimum/maximum radius, tortuosity, branching angle, generation, Strahler
+order, and path length from the trachea are output for every segment.
 */
 
 // ITK includes
@@ -14,18 +18,30 @@ Excel.
 #include <itkTubeSpatialObject.h>
 #include <itkSpatialObjectReader.h>
 #include <itkSpatialObjectWriter.h>
+#include <fstream>
+#include "lapdMouseStageCache.h"
+#include "lapdMouseTreeSegments.h"
+#include "lapdMouseTreeMorphometry.h"
 
 int main(int argc, char**argv)
 {
-  if (argc!=3)
+  bool morphometryColumns = argc==4 && std::string(argv[3])=="--morphometry";
+  if (argc!=3 && !morphometryColumns)
   {
-    std::cerr << "Usage: " << argv[0] << " input output" << std::endl;
+    std::cerr << "Usage: " << argv[0] << " input output [--morphometry]" << std::endl;
     return -1;
   }
 
   std::string inputFilename = argv[1];
   std::string outputFilename = argv[2];
 
+  // reuse output of a previous run with identical input and parameters
+  lapdMouse::StageCache cache( "simplifyTree" );
+  cache.AddInputFile( inputFilename );
+  cache.AddParameter( "morphometry", morphometryColumns );
+  if (cache.Restore( "table", outputFilename ))
+    return 0;
+
   // read spatial objects
   using SpatialObjectType = itk::SpatialObject<3>;
   using ReaderType = itk::SpatialObjectReader<3,float>;
@@ -34,18 +50,17 @@ int main(int argc, char**argv)
   reader->Update();
   SpatialObjectType::Pointer tree( reader->GetGroup() );
 
-  // obtain list of tree segments and store in map segmentID -> SpatialObject
-  using TubeType = itk::TubeSpatialObject<3>;
-  using SegmentMapType = std::map<int, TubeType::Pointer>;
-  SegmentMapType segmentMap;
-  SpatialObjectType::ChildrenListType* segments = tree->GetChildren(
-    SpatialObjectType::MaximumDepth, (char*)"VesselTubeSpatialObject");
-  for (SpatialObjectType::ChildrenListType::iterator segmentIt = segments->begin();
-    segmentIt!=segments->end(); ++segmentIt)
-  {
-    TubeType::Pointer segment( dynamic_cast<TubeType*>(segmentIt->GetPointer()) );
-    segmentMap[segment->GetId()] = segment;
-  }
+  // obtain tree segments sorted by segmentID as contiguous arrays of
+  // centerline points; if parent is an airway segment, the connection point
+  // is the first of the current segment's points; otherwise segments with
+  // only one centerline point would have a length of 0
+  const lapdMouse::TreeSegments segments =
+    lapdMouse::FlattenTree( tree.GetPointer(), true );
+
+  // calculate center/radius/direction and further measurements of all
+  // segments based on centerline points
+  const std::vector<lapdMouse::SegmentMorphometry> morphometry =
+    lapdMouse::ComputeMorphometry( segments );
 
   // open output file for writing
   std::ofstream outfile;
@@ -53,51 +68,32 @@ int main(int argc, char**argv)
 
   // write header
   outfile << "label,parent,length,radius,name,centroidX,"
-    << "centroidY,centroidZ,directionX,directionY,directionZ"
-    << std::endl;
+    << "centroidY,centroidZ,directionX,directionY,directionZ";
+  if (morphometryColumns)
+    outfile << ",arcLength,minRadius,maxRadius,tortuosity,branchingAngle,"
+      << "generation,strahlerOrder,pathLength";
+  outfile << std::endl;
 
-  for (SegmentMapType::const_iterator it=segmentMap.begin();
-    it!=segmentMap.end(); ++it)
+  for (size_t s=0; s<segments.GetNumberOfSegments(); ++s)
   {
-    TubeType::Pointer segment = it->second;
-
-    // calculate center/radius/direction of segment based on centerline points
-    TubeType::TubePointListType points = segment->GetPoints();
-    // if parent is an airway segment, add connection point to list of the
-    // current segment's points; otherwise segments with only one centerline
-    // point would have a length of 0
-    if (segment->GetParent()->GetNameOfClass()==segment->GetNameOfClass())
-    {
-      TubeType::Pointer parent(
-        dynamic_cast<TubeType*>(segment->GetParent()) );
-      points.insert(points.begin(),
-        parent->GetPoints()[segment->GetParentPoint()]);
-        //parent->GetPoints()[parent->GetNumberOfPoints()-1]);
-    }
-    using PointType = TubeType::TubePointType::PointType;
-    using VectorType = TubeType::TubePointType::VectorType;
-    PointType startPoint = points[0].GetPositionInObjectSpace();
-    PointType endPoint = points[points.size()-1].GetPositionInObjectSpace();
-    PointType center; center.SetToMidPoint(startPoint, endPoint);
-    VectorType direction = endPoint-startPoint;
-    double length = direction.GetNorm();
-    direction /= length;
-    double radius = 0;
-    for (size_t i=0; i<points.size(); ++i)
-      radius += points[i].GetRadiusInObjectSpace();
-    radius /= double(points.size());
+    const lapdMouse::SegmentMorphometry& m = morphometry[s];
 
     // write segment information
-    outfile << segment->GetId() << ","
-      << segment->GetParent()->GetId() << ","
-      << length << "," << radius << ","
-      << segment->GetProperty().GetName() << ","
-      << center[0] << "," << center[1] << "," << center[2] << ","
-      << direction[0] << "," << direction[1] << "," << direction[2]
-      << std::endl;
+    outfile << segments.ids[s] << ","
+      << segments.parentIds[s] << ","
+      << m.length << "," << m.meanRadius << ","
+      << segments.names[s] << ","
+      << m.center[0] << "," << m.center[1] << "," << m.center[2] << ","
+      << m.direction[0] << "," << m.direction[1] << "," << m.direction[2];
+    if (morphometryColumns)
+      outfile << "," << m.arcLength << "," << m.minRadius << ","
+        << m.maxRadius << "," << m.tortuosity << "," << m.branchingAngle << ","
+        << m.generation << "," << m.strahlerOrder << "," << m.pathLength;
+    outfile << std::endl;
   }
 
   outfile.close();
+  cache.Store( "table", outputFilename );
 
   return 0;
 }
@@ -0,0 +1,213 @@
+/*
+Tool to transfer labels between meshes and labelmaps.
+
+```bash
+./transferLabels labelmap2mesh m01_TerminalCompartments.nrrd m01_AirwayOutlets.vtk m01_AirwayOutletsCompartments.vtk 0.1
+./transferLabels mesh2labelmap m01_AirwayOutlets.vtk m01_Lobes.nrrd m01_AirwayOutlets.nrrd
+```
+
+labelmap2mesh assigns every vertex of a mesh the label of the voxel it lies
+in, e.g. the TerminalCompartments or NearAcini region of every
+AirwayOutlets.vtk vertex, and stores the labels as point data of the output
+mesh. Labelmaps stored as dense ordinals are translated back to their original
+labels. With the optional search radius (in physical units, e.g. mm),
+vertices on background voxels are assigned the label of the closest labeled
+voxel within this radius instead, as vertices on a surface often lie just
+outside the labeled region.
+
+mesh2labelmap paints the nonzero point data of a mesh (e.g. outlet or segment
+IDs) into a labelmap with the voxel grid of a reference image: every voxel
+containing a vertex is assigned the vertex's value; if several vertices fall
+into one voxel, the last vertex wins. The labelmap is stored compressed along
+with a table mapping its ordinals to labels.
+
+In both directions the mapping from physical points to voxel indices is
+precomputed once and applied to batches of vertices in parallel.
+*/
+
+#include <itkImage.h>
+#include <itkImageFileReader.h>
+#include <itkMesh.h>
+#include <itkMeshFileWriter.h>
+#include <itkMultiThreaderBase.h>
+#include <algorithm>
+#include <cstdlib>
+#include "lapdMouseAsyncReader.h"
+#include "lapdMouseCompactLabelmap.h"
+#include "lapdMouseImageSampler.h"
+
+using MeshType = itk::Mesh< float, 3 >;
+
+// vertices of a mesh as contiguous x/y/z arrays
+struct MeshVertices
+{
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+
+  explicit MeshVertices(const MeshType* mesh)
+  {
+    const size_t numberOfVertices = mesh->GetNumberOfPoints();
+    x.reserve(numberOfVertices);
+    y.reserve(numberOfVertices);
+    z.reserve(numberOfVertices);
+    const MeshType::PointsContainer* points = mesh->GetPoints();
+    for (MeshType::PointsContainer::ConstIterator pointIt=points->Begin();
+      pointIt!=points->End(); ++pointIt)
+    {
+      x.push_back(pointIt.Value()[0]);
+      y.push_back(pointIt.Value()[1]);
+      z.push_back(pointIt.Value()[2]);
+    }
+  }
+
+  size_t GetNumberOfVertices() const { return x.size(); }
+};
+
+// vertices are processed in blocks of this size
+const size_t VertexBlockSize = 4096;
+
+// assign labels of labelmap with pixel type TLabel to mesh vertices
+template <typename TLabel>
+void TransferLabelmapToMesh(const std::string& labelmapFilename,
+  const std::string& meshFilename, const std::string& outputFilename,
+  float searchRadius)
+{
+  // start reading labelmap and mesh concurrently
+  using LabelmapType = itk::Image< TLabel, 3 >;
+  std::future<typename LabelmapType::Pointer> labelmapFuture =
+    lapdMouse::ReadImageAsync<LabelmapType>( labelmapFilename );
+  std::future<MeshType::Pointer> meshFuture =
+    lapdMouse::ReadMeshAsync<MeshType>( meshFilename );
+  const lapdMouse::CompactLabelTable labelTable =
+    lapdMouse::ReadLabelTable( labelmapFilename );
+
+  MeshType::Pointer mesh = meshFuture.get();
+  const MeshVertices vertices( mesh.GetPointer() );
+  const size_t numberOfVertices = vertices.GetNumberOfVertices();
+
+  typename LabelmapType::Pointer labelmap = labelmapFuture.get();
+  const lapdMouse::NearestNeighborSampler<LabelmapType> sampler( labelmap.GetPointer() );
+
+  // look up ordinals of all vertices
+  std::vector<TLabel> ordinals(numberOfVertices);
+  const size_t numberOfBlocks = (numberOfVertices+VertexBlockSize-1)/VertexBlockSize;
+  itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+  threader->ParallelizeArray( 0, numberOfBlocks,
+    [&](itk::SizeValueType block)
+    {
+      const size_t first = block*VertexBlockSize;
+      const size_t count = std::min(VertexBlockSize, numberOfVertices-first);
+      sampler.Sample( &vertices.x[first], &vertices.y[first], &vertices.z[first],
+        count, &ordinals[first], searchRadius );
+    }, nullptr );
+
+  // replace point data with labels and write mesh
+  MeshType::PointDataContainer::Pointer pointData = MeshType::PointDataContainer::New();
+  pointData->Reserve( numberOfVertices );
+  size_t v = 0;
+  for (MeshType::PointsContainer::ConstIterator pointIt=mesh->GetPoints()->Begin();
+    pointIt!=mesh->GetPoints()->End(); ++pointIt, ++v)
+    pointData->SetElement( pointIt.Index(), labelTable.GetLabel( ordinals[v] ) );
+  mesh->SetPointData( pointData );
+
+  typedef itk::MeshFileWriter<MeshType> WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( mesh );
+  writer->SetFileName( outputFilename.c_str() );
+  writer->SetUseCompression( true );
+  writer->Update();
+}
+
+// paint nonzero point data of mesh into labelmap with grid of reference image
+void TransferMeshToLabelmap(const std::string& meshFilename,
+  const std::string& referenceFilename, const std::string& outputFilename)
+{
+  std::future<MeshType::Pointer> meshFuture =
+    lapdMouse::ReadMeshAsync<MeshType>( meshFilename );
+
+  // read grid information of reference image; its pixel data is not needed
+  using LabelmapType = itk::Image< unsigned int, 3 >;
+  using ReaderType = itk::ImageFileReader<LabelmapType>;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( referenceFilename );
+  reader->UpdateOutputInformation();
+  LabelmapType::Pointer labelmap = LabelmapType::New();
+  labelmap->CopyInformation( reader->GetOutput() );
+  labelmap->SetRegions( reader->GetOutput()->GetLargestPossibleRegion() );
+  labelmap->Allocate();
+  labelmap->FillBuffer(0);
+  const lapdMouse::NearestNeighborSampler<LabelmapType> sampler( labelmap.GetPointer() );
+
+  MeshType::Pointer mesh = meshFuture.get();
+  const MeshVertices vertices( mesh.GetPointer() );
+  const size_t numberOfVertices = vertices.GetNumberOfVertices();
+  if (mesh->GetPointData()==nullptr || mesh->GetPointData()->Size()!=numberOfVertices)
+    itkGenericExceptionMacro( "mesh does not provide point data for every vertex: " << meshFilename );
+
+  // compute voxel offsets of all vertices in parallel
+  std::vector<long> offsets(numberOfVertices);
+  const size_t numberOfBlocks = (numberOfVertices+VertexBlockSize-1)/VertexBlockSize;
+  itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+  threader->ParallelizeArray( 0, numberOfBlocks,
+    [&](itk::SizeValueType block)
+    {
+      const size_t first = block*VertexBlockSize;
+      const size_t count = std::min(VertexBlockSize, numberOfVertices-first);
+      sampler.ComputeOffsets( &vertices.x[first], &vertices.y[first],
+        &vertices.z[first], count, &offsets[first] );
+    }, nullptr );
+
+  // paint labels in vertex order, so that the result is deterministic
+  unsigned int* buffer = labelmap->GetBufferPointer();
+  const MeshType::PointDataContainer* pointData = mesh->GetPointData();
+  size_t v = 0;
+  for (MeshType::PointDataContainer::ConstIterator pointDataIt=pointData->Begin();
+    pointDataIt!=pointData->End(); ++pointDataIt, ++v)
+  {
+    const unsigned int label = (unsigned int)pointDataIt.Value();
+    if (label!=0 && offsets[v]>=0)
+      buffer[offsets[v]] = label;
+  }
+
+  // write labelmap compressed with dense ordinals
+  lapdMouse::WriteCompactLabelmap( labelmap.GetPointer(), outputFilename );
+}
+
+int main(int argc, char**argv)
+{
+  const std::string mode = argc>1 ? argv[1] : "";
+  if (!(mode=="labelmap2mesh" && (argc==5 || argc==6)) &&
+    !(mode=="mesh2labelmap" && argc==5))
+  {
+    std::cerr << "Usage: " << argv[0] << " labelmap2mesh labelmap mesh outputMesh [searchRadius]" << std::endl;
+    std::cerr << "       " << argv[0] << " mesh2labelmap mesh referenceImage outputLabelmap" << std::endl;
+    return -1;
+  }
+
+  try
+  {
+    if (mode=="labelmap2mesh")
+    {
+      std::string labelmapFilename = argv[2];
+      std::string meshFilename = argv[3];
+      std::string outputFilename = argv[4];
+      const float searchRadius = argc==6 ? static_cast<float>(atof(argv[5])) : 0.0f;
+      lapdMouse::DispatchOnLabelPixelType( labelmapFilename, [&](auto tag)
+      {
+        using LabelType = typename decltype(tag)::Type;
+        TransferLabelmapToMesh<LabelType>( labelmapFilename, meshFilename,
+          outputFilename, searchRadius );
+      });
+    }
+    else
+      TransferMeshToLabelmap( argv[2], argv[3], argv[4] );
+  }
+  catch( itk::ExceptionObject & e )
+  {
+    std::cout << e << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}